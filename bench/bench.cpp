@@ -0,0 +1,384 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+//Throughput harness for the reader and writer, run with make bench.
+//Tables are synthetic and seeded so runs on different builds are comparable.
+
+#include <parquet.hpp>
+#include <kalloc.hpp>
+#include <arrow/util/compression.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <sstream>
+
+using namespace KDB::PARQ;
+
+namespace{
+    struct Options{
+        J rows = 1000000;
+        J cardinality = 1024;
+        double nulls = 0;
+        int repeat = 3;
+        std::vector<std::string> types;
+        std::vector<std::string> codecs {"UNCOMPRESSED", "SNAPPY", "ZSTD"};
+        std::vector<int> threads {1, 4};
+        std::vector<std::string> project {"long", "symbol"};
+        std::string dir = "/tmp";
+        std::string out = "build/bench.json";
+    };
+
+    struct Column{
+        const char* name;
+        int type;
+    };
+
+    //Every q type the writer supports, string is a list of char vectors
+    const std::vector<Column> columns {
+        {"boolean", KB}, {"guid", UU}, {"byte", KG}, {"short", KH}, {"int", KI}, {"long", KJ},
+        {"real", KE}, {"float", KF}, {"char", KC}, {"symbol", KS}, {"timestamp", KP}, {"month", KM},
+        {"date", KD}, {"datetime", KZ}, {"timespan", KN}, {"minute", KU}, {"second", KV}, {"time", KT},
+        {"string", 0}, {"enum", 20}
+    };
+
+    struct Result{
+        std::string op, type, codec, encoding;
+        int threads;
+        J rows, bytes, fileBytes;
+        double seconds;
+    };
+
+    std::vector<std::string> split(const std::string& s){
+        std::vector<std::string> res;
+        std::stringstream stream {s};
+        for(std::string item; std::getline(stream, item, ',');)
+            if(!item.empty()) res.push_back(item);
+        return res;
+    }
+
+    S sym(const std::string& s){
+        return ss(const_cast<S>(s.c_str()));
+    }
+
+    K domain(J cardinality){
+        K res = ktn(KS, cardinality);
+        for(J i=0;i<cardinality;i++)
+            kS(res)[i] = sym("s" + std::to_string(i));
+        return res;
+    }
+
+    //Values are drawn from cardinality distinct ones, with nulls at the given rate
+    K generate(int type, const Options& opts){
+        std::mt19937_64 gen {static_cast<uint64_t>(type) * 7919 + 42};
+        std::uniform_int_distribution<J> value {0, std::max<J>(opts.cardinality, 1) - 1};
+        std::bernoulli_distribution null {WRITER::hasNull(type) && type != 20 ? opts.nulls : 0};
+        J n = opts.rows;
+        K col = ktn(type, n);
+        for(J i=0;i<n;i++){
+            J v = value(gen);
+            bool isNull = null(gen);
+            switch(type){
+                case KB: kG(col)[i] = v & 1; break;
+                case KG: kG(col)[i] = v & 0xff; break;
+                case KC: kC(col)[i] = 'a' + v % 26; break;
+                case UU:
+                    for(int j=0;j<16;j++)
+                        kU(col)[i].g[j] = isNull ? 0 : (v * 2654435761u) >> (j % 8 * 4);
+                    break;
+                case KH: kH(col)[i] = isNull ? nh : v % 32767; break;
+                case KI: case KM: case KD: kI(col)[i] = isNull ? ni : v; break;
+                case KU: kI(col)[i] = isNull ? ni : v % 1440; break;
+                case KV: kI(col)[i] = isNull ? ni : v % 86400; break;
+                case KT: kI(col)[i] = isNull ? ni : v * 1000 % 86400000; break;
+                case KJ: kJ(col)[i] = isNull ? nj : v * 1000003; break;
+                case KP: case KN: kJ(col)[i] = isNull ? nj : v * 1000000000LL; break;
+                case KE: kE(col)[i] = isNull ? NAN : v * 0.25f; break;
+                case KF: case KZ: kF(col)[i] = isNull ? NAN : v * 0.25; break;
+                case KS: kS(col)[i] = isNull ? sym("") : sym("s" + std::to_string(v)); break;
+                case 20: kJ(col)[i] = v; break;
+                default:
+                    kK(col)[i] = isNull ? ktn(KC, 0) : kp(const_cast<S>(("string" + std::to_string(v)).c_str()));
+            }
+        }
+        return col;
+    }
+
+    //In-memory payload the MB/s figures are measured against
+    J payload(K col){
+        switch(col->t){
+            case 0:{
+                J total = 0;
+                for(J i=0;i<col->n;i++) total += kK(col)[i]->n;
+                return total;
+            }
+            case KS:{
+                J total = 0;
+                for(J i=0;i<col->n;i++) total += std::strlen(kS(col)[i]);
+                return total;
+            }
+            case KB: case KG: case KC: return col->n;
+            case UU: return col->n * 16;
+            case KH: return col->n * 2;
+            case KI: case KE: case KM: case KD: case KU: case KV: case KT: return col->n * 4;
+            default: return col->n * 8;
+        }
+    }
+
+    K table(const std::vector<std::string>& names, const std::vector<K>& cols){
+        K keys = ktn(KS, 0);
+        K values = ktn(0, 0);
+        for(size_t i=0;i<names.size();i++){
+            js(&keys, sym(names[i]));
+            jk(&values, r1(cols[i]));
+        }
+        return xT(xD(keys, values));
+    }
+
+    K dict(const std::vector<std::pair<std::string, K>>& entries){
+        K keys = ktn(KS, 0);
+        K values = ktn(0, 0);
+        for(auto& entry : entries){
+            js(&keys, sym(entry.first));
+            jk(&values, entry.second);
+        }
+        return xD(keys, values);
+    }
+
+    //Writer properties for one column, none means the writer's defaults
+    K writeProps(const std::string& name, bool nullable, const std::pair<parquet::Encoding::type, bool>* encoding){
+        std::vector<std::pair<std::string, K>> entries {{"nullable", kb(nullable)}};
+        if(encoding){
+            K column = encoding->second ? dict({{"dictionary", kb(1)}})
+                                        : dict({{"dictionary", kb(0)}, {"encoding", kj(encoding->first)}});
+            entries.push_back({"columns", dict({{name, column}})});
+        }
+        return dict(entries);
+    }
+
+    std::string path(const Options& opts, const std::string& name, int worker){
+        return opts.dir + "/parq-bench-" + name + "-" + std::to_string(worker) + ".parquet";
+    }
+
+    J fileSize(const std::string& file){
+        FILE* f = std::fopen(file.c_str(), "rb");
+        if(!f) return 0;
+        std::fseek(f, 0, SEEK_END);
+        J size = std::ftell(f);
+        std::fclose(f);
+        return size;
+    }
+
+    void check(K res, const std::string& what){
+        if(!res)
+            throw std::runtime_error(what + " returned null");
+        bool error = res->t == -128;
+        std::string msg = error ? res->s : "";
+        r0(res);
+        if(error)
+            throw std::runtime_error(what + ": " + msg);
+    }
+
+    //Best wall time of the repeats, each running the task once per thread
+    double timed(int threads, int repeat, const std::function<void(int)>& task){
+        double best = std::numeric_limits<double>::max();
+        for(int r=0;r<repeat;r++){
+            std::vector<std::thread> pool;
+            std::vector<std::string> errors(threads);
+            auto start = std::chrono::steady_clock::now();
+            for(int w=0;w<threads;w++)
+                pool.emplace_back([&, w]{
+                    try{ task(w); }
+                    catch(const std::exception& e){ errors[w] = e.what(); }
+                });
+            for(auto& t : pool) t.join();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            for(auto& e : errors)
+                if(!e.empty()) throw std::runtime_error(e);
+        }
+        return best;
+    }
+
+    std::string encodingName(const std::pair<parquet::Encoding::type, bool>& encoding){
+        return encoding.second ? "DICTIONARY" : parquet::EncodingToString(encoding.first);
+    }
+
+    void bench(const Options& opts, const Column& column, K col, parquet::Compression::type codec,
+               const std::string& codecName, int threads, std::vector<Result>& results){
+        std::vector<std::string> names {column.name};
+        K t = table(names, {col});
+        J bytes = payload(col);
+        K schemaCols = ktn(0, 1);
+        kK(schemaCols)[0] = r1(col);
+        parquet::SchemaDescriptor schema;
+        schema.Init(WRITER::SetupSchema(kK(t->k)[0], schemaCols, 1, false));
+        r0(schemaCols);
+
+        K none = ktn(0, 0);
+        for(auto encoding : TUNER::encodings(schema.Column(0)->physical_type())){
+            K props = writeProps(column.name, opts.nulls > 0, &encoding);
+            try{
+                double write = timed(threads, opts.repeat, [&](int w){
+                    check(PWRITE::write(t, path(opts, column.name, w), true, codec, false, none, props), "write");
+                });
+                double read = timed(threads, opts.repeat, [&](int w){
+                    check(PKDB::readGroup(path(opts, column.name, w), 0, none, none), "read");
+                });
+                J fileBytes = fileSize(path(opts, column.name, 0));
+                results.push_back({"write", column.name, codecName, encodingName(encoding), threads,
+                                   opts.rows * threads, bytes * threads, fileBytes * threads, write});
+                results.push_back({"read", column.name, codecName, encodingName(encoding), threads,
+                                   opts.rows * threads, bytes * threads, fileBytes * threads, read});
+                std::fprintf(stderr, "%-10s %-12s %-24s %2d threads  write %8.1f MB/s  read %8.1f MB/s\n",
+                             column.name, codecName.c_str(), encodingName(encoding).c_str(), threads,
+                             bytes * threads / write / 1048576, bytes * threads / read / 1048576);
+            }catch(const std::exception& e){
+                //Encodings the writer rejects for a type are skipped, as in the tuner
+                std::fprintf(stderr, "%-10s %-12s %-24s skipped: %s\n",
+                             column.name, codecName.c_str(), encodingName(encoding).c_str(), e.what());
+            }
+            r0(props);
+        }
+        for(int w=0;w<threads;w++)
+            std::remove(path(opts, column.name, w).c_str());
+        r0(none);
+        r0(t);
+    }
+
+    //Reads a few columns out of a table holding every type, with pre-buffering on
+    void benchProjected(const Options& opts, const std::vector<const Column*>& selected, const std::vector<K>& cols,
+                        parquet::Compression::type codec, const std::string& codecName, int threads,
+                        std::vector<Result>& results){
+        std::vector<std::string> names;
+        for(auto c : selected) names.push_back(c->name);
+        K t = table(names, cols);
+        K props = writeProps("", opts.nulls > 0, nullptr);
+        K project = ktn(KS, 0);
+        J bytes = 0;
+        for(auto& name : opts.project)
+            for(size_t i=0;i<names.size();i++)
+                if(names[i] == name){
+                    js(&project, sym(name));
+                    bytes += payload(cols[i]);
+                }
+        if(project->n){
+            K readProps = dict({{"preBuffer", kb(1)}});
+            K none = ktn(0, 0);
+            timed(threads, 1, [&](int w){
+                check(PWRITE::write(t, path(opts, "all", w), true, codec, false, none, props), "write");
+            });
+            double read = timed(threads, opts.repeat, [&](int w){
+                check(PKDB::readGroup(path(opts, "all", w), 0, project, readProps), "projected read");
+            });
+            results.push_back({"projected", "", codecName, "", threads, opts.rows * threads, bytes * threads,
+                               fileSize(path(opts, "all", 0)) * threads, read});
+            std::fprintf(stderr, "%-10s %-12s %-24s %2d threads  read %8.1f MB/s\n", "projected", codecName.c_str(),
+                         "", threads, bytes * threads / read / 1048576);
+            for(int w=0;w<threads;w++)
+                std::remove(path(opts, "all", w).c_str());
+            r0(readProps);
+            r0(none);
+        }
+        r0(project);
+        r0(props);
+        r0(t);
+    }
+
+    void report(const Options& opts, const std::vector<Result>& results){
+        FILE* f = std::fopen(opts.out.c_str(), "w");
+        if(!f)
+            throw std::runtime_error("Unable to open " + opts.out);
+        std::fprintf(f, "{\"rows\":%lld,\"cardinality\":%lld,\"nulls\":%g,\"repeat\":%d,\"results\":[",
+                     opts.rows, opts.cardinality, opts.nulls, opts.repeat);
+        for(size_t i=0;i<results.size();i++){
+            const Result& r = results[i];
+            std::fprintf(f, "%s\n{\"op\":\"%s\",\"type\":\"%s\",\"codec\":\"%s\",\"encoding\":\"%s\",\"threads\":%d,"
+                         "\"rows\":%lld,\"bytes\":%lld,\"fileBytes\":%lld,\"seconds\":%.6f,"
+                         "\"rowsPerSec\":%.1f,\"mbPerSec\":%.3f}",
+                         i ? "," : "", r.op.c_str(), r.type.c_str(), r.codec.c_str(), r.encoding.c_str(), r.threads,
+                         r.rows, r.bytes, r.fileBytes, r.seconds,
+                         r.rows / r.seconds, r.bytes / r.seconds / 1048576);
+        }
+        std::fprintf(f, "\n]}\n");
+        std::fclose(f);
+    }
+
+    Options parse(int argc, char** argv){
+        Options opts;
+        for(int i=1;i+1<argc;i+=2){
+            std::string flag {argv[i]}, value {argv[i+1]};
+            if(flag == "--rows") opts.rows = std::stoll(value);
+            else if(flag == "--cardinality") opts.cardinality = std::stoll(value);
+            else if(flag == "--nulls") opts.nulls = std::stod(value);
+            else if(flag == "--repeat") opts.repeat = std::stoi(value);
+            else if(flag == "--types") opts.types = split(value);
+            else if(flag == "--codecs") opts.codecs = split(value);
+            else if(flag == "--project") opts.project = split(value);
+            else if(flag == "--dir") opts.dir = value;
+            else if(flag == "--out") opts.out = value;
+            else if(flag == "--threads"){
+                opts.threads.clear();
+                for(auto& t : split(value)) opts.threads.push_back(std::stoi(t));
+            }
+            else throw std::runtime_error("Unknown option " + flag);
+        }
+        return opts;
+    }
+}
+
+int main(int argc, char** argv){
+    try{
+        Options opts = parse(argc, argv);
+        K enumDomain = domain(opts.cardinality);
+        benchDomain(enumDomain);
+
+        std::vector<const Column*> selected;
+        std::vector<K> cols;
+        for(auto& column : columns)
+            if(opts.types.empty() || std::find(opts.types.begin(), opts.types.end(), column.name) != opts.types.end()){
+                selected.push_back(&column);
+                cols.push_back(generate(column.type, opts));
+            }
+
+        std::vector<Result> results;
+        for(auto& codecName : opts.codecs){
+            std::string lower = codecName;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            auto codec = arrow::util::Codec::GetCompressionType(lower);
+            if(!codec.ok() || !arrow::util::Codec::IsAvailable(*codec)){
+                std::fprintf(stderr, "Codec %s not available, skipped\n", codecName.c_str());
+                continue;
+            }
+            for(int threads : opts.threads){
+                THREADS::configure(threads, std::max(8, threads), threads, {});
+                for(size_t i=0;i<selected.size();i++)
+                    bench(opts, *selected[i], cols[i], *codec, codecName, threads, results);
+                benchProjected(opts, selected, cols, *codec, codecName, threads, results);
+            }
+        }
+        report(opts, results);
+        std::fprintf(stderr, "%zu results written to %s\n", results.size(), opts.out.c_str());
+
+        for(K col : cols) r0(col);
+        benchDomain(nullptr);
+        r0(enumDomain);
+        return 0;
+    }catch(const std::exception& e){
+        std::fprintf(stderr, "bench: %s\n", e.what());
+        return 1;
+    }
+}
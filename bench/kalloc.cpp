@@ -0,0 +1,211 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+//A minimal in-process implementation of the K allocation API, enough for
+//the library code to run standalone without a q process or licence
+
+#include <kalloc.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace{
+    std::mutex symMutex;
+    K enumDomain = nullptr;
+
+    std::unordered_set<std::string>& symbols(){
+        static auto* pool = new std::unordered_set<std::string>;
+        return *pool;
+    }
+
+    size_t width(int type){
+        switch(type < 0 ? -type : type){
+            case KB: case KG: case KC: return 1;
+            case UU: return 16;
+            case KH: return 2;
+            case KI: case KE: case KM: case KD: case KU: case KV: case KT: return 4;
+            default: return 8;
+        }
+    }
+
+    K alloc(int type, J n){
+        //Vectors keep their data 16 bytes in, after the header and length
+        K x = static_cast<K>(std::malloc(16 + width(type) * std::max<J>(n, 1)));
+        x->m = 0;
+        x->a = 0;
+        x->t = type;
+        x->u = 0;
+        x->r = 0;
+        x->n = n;
+        return x;
+    }
+
+    K atom(int type){
+        K x = static_cast<K>(std::malloc(sizeof(*x)));
+        x->m = 0;
+        x->a = 0;
+        x->t = type;
+        x->u = 0;
+        x->r = 0;
+        return x;
+    }
+
+    void extend(K* x, const void* value){
+        size_t size = width((*x)->t);
+        size_t used = 16 + size * ((*x)->n + 1);
+        if(malloc_usable_size(*x) < used)
+            *x = static_cast<K>(std::realloc(*x, 16 + size * 2 * ((*x)->n + 1)));
+        std::memcpy(kG(*x) + size * (*x)->n++, value, size);
+    }
+}
+
+void benchDomain(K domain){
+    if(enumDomain) r0(enumDomain);
+    enumDomain = domain ? r1(domain) : nullptr;
+}
+
+extern "C"{
+    S ss(S s){
+        std::lock_guard<std::mutex> lock {symMutex};
+        return const_cast<S>(symbols().emplace(s).first->c_str());
+    }
+
+    S sn(S s, I n){
+        std::string sym {s, static_cast<size_t>(n)};
+        return ss(const_cast<S>(sym.c_str()));
+    }
+
+    K ktn(I type, J n){ return alloc(type, n); }
+
+    K kpn(S s, J n){
+        K x = alloc(KC, n);
+        std::memcpy(kG(x), s, n);
+        return x;
+    }
+
+    K kp(S s){ return kpn(s, std::strlen(s)); }
+
+    K ka(I type){ return atom(type); }
+    K kb(I b){ K x = atom(-KB); x->g = b; return x; }
+    K kg(I g){ K x = atom(-KG); x->g = g; return x; }
+    K kc(I c){ K x = atom(-KC); x->g = c; return x; }
+    K kh(I h){ K x = atom(-KH); x->h = h; return x; }
+    K ki(I i){ K x = atom(-KI); x->i = i; return x; }
+    K kd(I i){ K x = atom(-KD); x->i = i; return x; }
+    K kt(I i){ K x = atom(-KT); x->i = i; return x; }
+    K kj(J j){ K x = atom(-KJ); x->j = j; return x; }
+    K ktj(I type, J j){ K x = atom(type); x->j = j; return x; }
+    K ke(F e){ K x = atom(-KE); x->e = e; return x; }
+    K kf(F f){ K x = atom(-KF); x->f = f; return x; }
+    K kz(F f){ K x = atom(-KZ); x->f = f; return x; }
+    K ks(S s){ K x = atom(-KS); x->s = ss(s); return x; }
+
+    K ku(U u){
+        K x = alloc(-UU, 1);
+        std::memcpy(kG(x), u.g, 16);
+        return x;
+    }
+
+    K krr(const S s){
+        K x = atom(-128);
+        x->s = ss(s);
+        return x;
+    }
+
+    K orr(const S s){ return krr(s); }
+
+    //Counts are atomic as writer threads share the input columns
+    K r1(K x){
+        __atomic_add_fetch(&x->r, 1, __ATOMIC_RELAXED);
+        return x;
+    }
+
+    V r0(K x){
+        if(!x) return;
+        if(__atomic_fetch_sub(&x->r, 1, __ATOMIC_ACQ_REL) > 0)
+            return;
+        if(x->t == XT)
+            r0(x->k);
+        else if(x->t == 0 || x->t == XD)
+            for(J i=0;i<x->n;i++)
+                r0(kK(x)[i]);
+        std::free(x);
+    }
+
+    K ja(K* x, V* value){
+        extend(x, value);
+        return *x;
+    }
+
+    K js(K* x, S s){
+        extend(x, &s);
+        return *x;
+    }
+
+    K jk(K* x, K y){
+        extend(x, &y);
+        return *x;
+    }
+
+    //Items of a general list are shared with y, so they take a reference each
+    K jv(K* x, K y){
+        for(J i=0;i<y->n;i++){
+            if(!y->t)
+                r1(kK(y)[i]);
+            extend(x, kG(y) + width(y->t) * i);
+        }
+        return *x;
+    }
+
+    K knk(I n, ...){
+        K x = alloc(0, n);
+        va_list args;
+        va_start(args, n);
+        for(I i=0;i<n;i++)
+            kK(x)[i] = va_arg(args, K);
+        va_end(args);
+        return x;
+    }
+
+    K xD(K keys, K values){
+        K x = alloc(XD, 2);
+        kK(x)[0] = keys;
+        kK(x)[1] = values;
+        return x;
+    }
+
+    K xT(K dict){
+        K x = atom(XT);
+        x->k = dict;
+        return x;
+    }
+
+    K k(I handle, const S expr, ...){
+        //Only the enum lookup is evaluated; arguments are consumed as q does
+        va_list args;
+        va_start(args, expr);
+        for(K arg = va_arg(args, K); arg; arg = va_arg(args, K))
+            r0(arg);
+        va_end(args);
+        if(handle == 0 && enumDomain && std::strcmp(expr, "{value key x}") == 0)
+            return r1(enumDomain);
+        return krr(const_cast<S>("nyi"));
+    }
+}
@@ -0,0 +1,26 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_KALLOC
+#define KDB_PARQUET_KALLOC
+
+#include <k.h>
+
+//The bench links this in place of q's c.o, registering the domain that
+//enumerated columns resolve against in the same way q would
+void benchDomain(K domain);
+
+#endif
@@ -0,0 +1,106 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef KDB_PARQUET_AGGREGATE
+#define KDB_PARQUET_AGGREGATE
+
+#include <summary.hpp>
+#include <threads.hpp>
+#include <string_view>
+#include <unordered_map>
+
+namespace KDB{
+    namespace PARQ{
+        //Grouped aggregations computed from decoded batches, one row group per worker,
+        //so only the aggregated rows are ever built as K objects
+        class AGGREGATE{
+            public:
+                enum Function {count, sum, min, max, first, last, avg};
+                enum Lane {integer, real, text};
+
+                //A column being read, integer and real values are held as q holds them once scaled and shifted
+                struct Column{
+                    int index;
+                    std::string name;
+                    int type;
+                    Lane lane;
+                    J scale;
+                    J shift;
+                };
+                struct By{
+                    int column;
+                    J width;
+                    double realWidth;
+                };
+                struct Agg{
+                    Function function;
+                    int column;
+                };
+                struct Filter{
+                    int column;
+                    std::optional<J> low, high;
+                    std::optional<double> realLow, realHigh;
+                    std::optional<std::string> textLow, textHigh;
+                    K range;
+                };
+                struct Plan{
+                    std::vector<Column> columns;
+                    std::vector<By> by;
+                    std::vector<Agg> aggs;
+                    std::vector<Filter> filters;
+                };
+
+                //One batch of a column, in the same rows as every other column's batch
+                struct Batch{
+                    std::vector<J> ints;
+                    std::vector<double> reals;
+                    std::vector<std::string_view> texts;
+                    std::string arena;
+                    std::vector<uint8_t> valid;
+                };
+                //Running value of one aggregation in one group, what i, f and s hold depends on the function
+                struct Acc{
+                    J rows = 0;
+                    J valid = 0;
+                    J i = 0;
+                    double f = 0;
+                    std::string s;
+                };
+                //Groups of a row group, or of the whole file once merged
+                struct Partial{
+                    std::unordered_map<std::string, size_t> index;
+                    std::vector<std::string> keys;
+                    std::vector<Acc> accs;
+                };
+
+                static K run(const std::string& file, K by, K aggs, K filters, K props);
+                static Plan plan(const parquet::SchemaDescriptor* schema, K by, K aggs, K filters);
+                static int column(Plan& plan, const parquet::SchemaDescriptor* schema, const std::string& name);
+                static bool fromStatistics(const parquet::RowGroupMetaData& rowGroup, const Plan& plan, Partial& partial);
+                static void scan(std::shared_ptr<parquet::RowGroupReader> rowGroup, const Plan& plan, Partial& partial);
+                static void decode(parquet::ColumnReader* reader, const Column& column, J rows, Batch& batch);
+                static void update(Acc& acc, Function function, const Column& column, const Batch& batch, J row);
+                static void combine(Acc& acc, const Acc& from, Function function, Lane lane);
+                static void merge(Partial& into, const Partial& from, const Plan& plan);
+                static K result(const Plan& plan, const Partial& partial, K by, K aggs);
+
+                static J null(int type);
+                static void set(K vector, J index, J value, double real);
+        };
+    }
+}
+#endif
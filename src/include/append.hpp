@@ -0,0 +1,71 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef KDB_PARQUET_APPEND
+#define KDB_PARQUET_APPEND
+
+#include <writer.hpp>
+#include <parquet/file_reader.h>
+
+namespace KDB{
+    namespace PARQ{
+        //Appends row groups to a closed file. The new row groups are written over the old footer and
+        //a merged footer goes after them, with a journal of the old footer to undo an interrupted append
+        class APPEND{
+            public:
+                //The file before the append, no metadata when it's a new file. The sink is closed
+                //before the footer is rewritten, so buffered writes are on disk when it's read back
+                struct State{
+                    std::string fileName;
+                    std::shared_ptr<parquet::FileMetaData> metadata;
+                    int64_t footer = 0;
+                    std::shared_ptr<arrow::io::OutputStream> sink;
+                };
+
+                //Starts where the old footer did, dropping the magic bytes every new writer opens with
+                class Stream : public arrow::io::OutputStream{
+                    public:
+                        Stream(std::shared_ptr<arrow::io::OutputStream> sink, int64_t start);
+
+                        arrow::Status Close() override;
+                        bool closed() const override;
+                        arrow::Result<int64_t> Tell() const override;
+                        arrow::Status Write(const void* data, int64_t nbytes) override;
+                        arrow::Status Flush() override;
+
+                    private:
+                        std::shared_ptr<arrow::io::OutputStream> sink;
+                        int64_t position;
+                        int64_t skip;
+                };
+
+                static std::shared_ptr<parquet::ParquetFileWriter> open(const std::string& fileName,
+                                                                        std::shared_ptr<GroupNode> schema,
+                                                                        parquet::Compression::type codec,
+                                                                        K metadata,
+                                                                        K props,
+                                                                        State& state);
+                static std::shared_ptr<parquet::FileMetaData> finish(const State& state,
+                                                                     std::shared_ptr<parquet::ParquetFileWriter> writer);
+                static bool recover(const std::string& fileName);
+                static std::string journal(const std::string& fileName);
+                static int64_t footer(const std::string& fileName, int64_t& size);
+                static void sync(const std::string& fileName);
+        };
+    }
+}
+#endif
@@ -0,0 +1,89 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_ASYNCFILE
+#define KDB_PARQUET_ASYNCFILE
+
+#include <utils.hpp>
+#include <arrow/buffer.h>
+#include <arrow/io/interfaces.h>
+#include <arrow/memory_pool.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace KDB{
+    namespace PARQ{
+        //Output stream that gathers writes into large buffers and hands full ones to its own IO
+        //thread, so encoding carries on while earlier pages are written out
+        class ASYNCFILE : public arrow::io::OutputStream{
+            public:
+                static arrow::Result<std::shared_ptr<arrow::io::OutputStream>> Open(const std::string& path,
+                                                                                    bool append,
+                                                                                    int64_t bufferSize,
+                                                                                    int64_t preallocate,
+                                                                                    bool sync,
+                                                                                    arrow::MemoryPool* pool);
+                ~ASYNCFILE() override;
+
+                arrow::Status Close() override;
+                bool closed() const override;
+                arrow::Result<int64_t> Tell() const override;
+                arrow::Status Write(const void* data, int64_t nbytes) override;
+                arrow::Status Flush() override;
+
+                //One buffer fills while the other is written
+                static constexpr int buffers = 2;
+
+            private:
+                struct Block{
+                    arrow::Buffer* buffer;
+                    int64_t length;
+                    int64_t offset;
+                };
+
+                ASYNCFILE(int fd, int64_t offset, int64_t preallocate, bool sync,
+                          std::vector<std::unique_ptr<arrow::Buffer>> pool);
+                void run();
+                arrow::Status submit();
+                arrow::Status drain();
+                arrow::Status reserve(int64_t end);
+
+                int fd;
+                int64_t position;
+                int64_t offset;
+                int64_t preallocate;
+                int64_t reserved;
+                bool sync;
+                std::vector<std::unique_ptr<arrow::Buffer>> owned;
+                arrow::Buffer* current;
+                int64_t fill;
+
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::deque<Block> queue;
+                std::vector<arrow::Buffer*> free;
+                bool writing;
+                bool stopping;
+                arrow::Status error;
+                std::thread thread;
+        };
+    }
+}
+#endif
@@ -0,0 +1,38 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_BYTES
+#define KDB_PARQUET_BYTES
+
+#include <reader.hpp>
+#include <writer.hpp>
+
+namespace KDB{
+    namespace PARQ{
+        //Parquet images held in q byte vectors, for files passed over IPC or message queues
+        //without a round trip through disk
+        class BYTES{
+            public:
+                static std::shared_ptr<parquet::ParquetFileReader> open(K bytes);
+                static K read(K bytes, J group, K cols);
+                static K write(K tables, parquet::Compression::type codec, K metadata, K props);
+
+                //Starting size of the output buffer, it doubles as the image grows
+                static constexpr int64_t initialCapacity = 1 << 20;
+        };
+    }
+}
+#endif
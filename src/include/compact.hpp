@@ -0,0 +1,102 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef KDB_PARQUET_COMPACT
+#define KDB_PARQUET_COMPACT
+
+#include <reader.hpp>
+#include <writer.hpp>
+#include <threads.hpp>
+#include <parquet/metadata.h>
+
+namespace KDB{
+    namespace PARQ{
+        //Merges the row groups of many files into fewer, larger ones. Row groups that are already
+        //big enough and encoded as the writer would are copied byte for byte, the rest are decoded
+        //and encoded again column by column, so only one column chunk is held at a time
+        class COMPACT{
+            public:
+                struct Input{
+                    std::string fileName;
+                    std::shared_ptr<arrow::io::RandomAccessFile> file;
+                    std::shared_ptr<parquet::ParquetFileReader> reader;
+                };
+                struct Source{
+                    int input;
+                    int rowGroup;
+                };
+                //One row group of the output
+                struct Group{
+                    std::vector<Source> sources;
+                    bool copy;
+                };
+                struct Result{
+                    J rowGroups = 0;
+                    J rows = 0;
+                    J copied = 0;
+                };
+
+                //Starts at the current end of the output, dropping the magic bytes every new writer
+                //opens with and everything after the row group once discarding
+                class Segment : public arrow::io::OutputStream{
+                    public:
+                        Segment(std::shared_ptr<arrow::io::OutputStream> sink, int64_t start);
+
+                        arrow::Status Close() override;
+                        bool closed() const override;
+                        arrow::Result<int64_t> Tell() const override;
+                        arrow::Status Write(const void* data, int64_t nbytes) override;
+                        arrow::Status Flush() override;
+                        void discard();
+
+                    private:
+                        std::shared_ptr<arrow::io::OutputStream> sink;
+                        int64_t position;
+                        int64_t skip;
+                        bool discarding;
+                        bool isClosed;
+                };
+
+                static K run(K inputs, K outputs, J target, parquet::Compression::type codec, K props);
+                static Result file(const std::vector<std::string>& inputs, const std::string& output,
+                                   J target, parquet::Compression::type codec, K props,
+                                   const std::vector<WRITER::ColumnOption>& columns);
+                static std::vector<Group> plan(const std::vector<Input>& inputs, J target,
+                                               const parquet::WriterProperties& writerProps);
+                static bool copyable(const parquet::RowGroupMetaData& rowGroup,
+                                     const parquet::WriterProperties& writerProps);
+                static void copy(const Group& group, const std::vector<Input>& inputs,
+                                 std::shared_ptr<arrow::io::OutputStream> sink,
+                                 parquet::FileMetaDataBuilder& builder);
+                static void encode(const Group& group, const std::vector<Input>& inputs,
+                                   std::shared_ptr<arrow::io::OutputStream> sink,
+                                   std::shared_ptr<parquet::WriterProperties> writerProps,
+                                   parquet::FileMetaDataBuilder& builder);
+                static void encodeColumn(parquet::ColumnReader* reader, parquet::ColumnWriter* writer);
+                template<typename T>
+                static void encodeColumn(parquet::ColumnReader* reader, parquet::ColumnWriter* writer);
+                static void addRowGroup(parquet::FileMetaDataBuilder& builder,
+                                        const parquet::RowGroupMetaData& rowGroup,
+                                        const std::vector<int64_t>& shifts);
+                static std::shared_ptr<const parquet::KeyValueMetadata> keyValueMetadata(const std::vector<Input>& inputs);
+
+                //Rows read and written per batch when encoding again
+                static constexpr int64_t batchSize = 65536;
+        };
+    }
+}
+#endif
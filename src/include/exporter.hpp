@@ -0,0 +1,48 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_EXPORTER
+#define KDB_PARQUET_EXPORTER
+
+#include <stream.hpp>
+
+namespace KDB{
+    namespace PARQ{
+        class EXPORTER{
+            public:
+                //A partition's columns as mapped by q, converted in row chunks by one of the workers
+                struct Task{
+                    std::string fileName;
+                    K names;
+                    K cols;
+                    //Mapped domain of each enumerated column, empty lists for the others
+                    K domains;
+                    J rows;
+                };
+
+                static K exportHdb(std::string root, K parts, K files, parquet::Compression::type codec,
+                                   K metadata, K props);
+                static K mapFile(const std::string& path);
+                static K domain(const std::string& root, K col, std::map<std::string, K>& domains);
+                static Task mapPartition(const std::string& root, const std::string& dir, const std::string& fileName,
+                                         std::map<std::string, K>& domains);
+                static void releaseTask(Task& task);
+                static void writeTask(const Task& task, parquet::Compression::type codec,
+                                      K metadata, K props, const std::vector<WRITER::ColumnOption>& columns);
+        };
+    }
+}
+#endif
@@ -19,6 +19,17 @@
 
 #include <reader.hpp>
 #include <writer.hpp>
+#include <tuner.hpp>
+#include <sorter.hpp>
+#include <stream.hpp>
+#include <partition.hpp>
+#include <exporter.hpp>
+#include <summary.hpp>
+#include <aggregate.hpp>
+#include <append.hpp>
+#include <compact.hpp>
+#include <sample.hpp>
+#include <bytes.hpp>
 
 namespace KDB{
     namespace PARQ{
@@ -28,21 +39,24 @@ namespace KDB{
                 ~PKDB();
 
                 static PKDB& getInstance(){return *instance;};
-                static K loadReader(std::string fileName);
+                static K loadReader(std::string fileName, K props);
                 static void updateMetaData();
-                static K readGroup(std::string fileName, int group, K cols);
+                static K readGroup(std::string fileName, int group, K cols, K props);
                 static K readTable(std::shared_ptr<parquet::RowGroupReader> row_group_reader, 
                                     int num_cols,
                                     int num_rows,
-                                    K cols);
+                                    K cols,
+                                    const PREADER::Plan& plan);
                 static int getColIndex(std::shared_ptr<parquet::RowGroupReader> row_group_reader, std::string colName);
                 static S readColName(std::shared_ptr<parquet::RowGroupReader> row_group_reader, int index);
-                static K getColData(std::shared_ptr<parquet::RowGroupReader> row_group_reader, int index, int num_rows);
+                static K getColData(std::shared_ptr<parquet::RowGroupReader> row_group_reader, int index, int num_rows,
+                                    const PREADER::Decoder& decoder);
                 static K close();
                 static void incrementCurrentRowGroup(){instance->currentRowGroup++;};
 
                 std::shared_ptr<parquet::ParquetFileReader> filerReader_;
                 std::shared_ptr<const parquet::KeyValueMetadata> key_value_metadata;
+                std::shared_ptr<const PREADER::Plan> plan_;
                 std::shared_ptr<parquet::RowGroupReader> row_group_reader;
                 const parquet::RowGroupMetaData* metaData;
                 int numColumns;
@@ -59,7 +73,9 @@ namespace KDB{
 
         class PWRITE{
             public:
-                PWRITE(std::shared_ptr<parquet::ParquetFileWriter> fileWriter);
+                PWRITE(std::shared_ptr<parquet::ParquetFileWriter> fileWriter,
+                       std::shared_ptr<arrow::io::OutputStream> sink, std::string fileName, bool summary,
+                       std::shared_ptr<APPEND::State> append);
                 ~PWRITE();
 
                 static PWRITE& getInstance(){return *instance;};
@@ -69,13 +85,22 @@ namespace KDB{
                                                                                     bool single,
                                                                                     parquet::Compression::type codec,
                                                                                     bool append,
-                                                                                    K metadata);
+                                                                                    K metadata,
+                                                                                    K props,
+                                                                                    std::shared_ptr<arrow::io::OutputStream>& sink,
+                                                                                    std::shared_ptr<APPEND::State>& state);
                 static K write(K table, std::string fileName, bool single,
-                               parquet::Compression::type codec, bool append, K metadata);
+                               parquet::Compression::type codec, bool append, K metadata, K props);
                 static K close();
 
                 std::shared_ptr<GroupNode> schema_;
                 std::shared_ptr<parquet::ParquetFileWriter> fileWriter_;
+                std::shared_ptr<arrow::io::OutputStream> sink_;
+                std::string fileName_;
+                //Add the file to the _metadata summary of its directory once closed
+                bool summary_;
+                //Set when appending to an existing file, its footer is merged on close
+                std::shared_ptr<APPEND::State> append_;
                 int currentRowGroup;
                 
             private:
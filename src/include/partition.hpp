@@ -0,0 +1,50 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_PARTITION
+#define KDB_PARQUET_PARTITION
+
+#include <sorter.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace KDB{
+    namespace PARQ{
+        class PARTITION{
+            public:
+                //A partition's rows gathered into their own table, written by one of the workers
+                struct Task{
+                    std::string fileName;
+                    K table;
+                    J rows;
+                };
+
+                static K write(K table, std::string root, K partCols,
+                               parquet::Compression::type codec, K metadata, K props);
+                static std::string directory(const std::vector<SORTER::Key>& keys, K names, J row);
+                static std::string format(const SORTER::Key& key, J row);
+                static std::string escape(const std::string& value);
+                static std::string date(I days, bool month);
+                static std::string nextFile(const std::string& dir);
+                static K gather(K col, K domain, const J* index, J len);
+                static bool partitionable(K col);
+                static void writeTask(const Task& task, parquet::Compression::type codec, K metadata, K props,
+                                      const std::vector<WRITER::ColumnOption>& columns);
+        };
+    }
+}
+#endif
@@ -0,0 +1,76 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_POOL
+#define KDB_PARQUET_POOL
+
+#include <utils.hpp>
+#include <stats.hpp>
+#include <arrow/memory_pool.h>
+#include <map>
+#include <mutex>
+
+namespace KDB{
+    namespace PARQ{
+        //Memory pool given to every reader and writer, so their decode and
+        //compression buffers can be limited, measured and reused
+        class POOL : public arrow::MemoryPool{
+            public:
+                POOL(arrow::MemoryPool* base);
+
+                static POOL& getInstance();
+
+                arrow::Status Allocate(int64_t size, int64_t alignment, uint8_t** out) override;
+                arrow::Status Reallocate(int64_t old_size, int64_t new_size, int64_t alignment, uint8_t** ptr) override;
+                void Free(uint8_t* buffer, int64_t size, int64_t alignment) override;
+                void ReleaseUnused() override;
+                int64_t bytes_allocated() const override;
+                int64_t max_memory() const override;
+                int64_t total_bytes_allocated() const override;
+                int64_t num_allocations() const override;
+                std::string backend_name() const override;
+
+                void configure(int64_t limit, int64_t cacheLimit, int64_t cacheMin);
+                void begin();
+                K stats();
+
+            private:
+                POOL(const POOL&) = delete;
+                void operator=(const POOL&) = delete;
+
+                arrow::Status reserve(int64_t size);
+                void account(int64_t size);
+                void releaseCache();
+
+                arrow::MemoryPool* base_;
+                mutable std::mutex mutex;
+                //Freed buffers kept by size for the next row group to reuse
+                std::multimap<int64_t, uint8_t*> cache;
+                int64_t limit;
+                int64_t cacheLimit;
+                int64_t cacheMin;
+                int64_t allocated;
+                int64_t cached;
+                int64_t peak;
+                int64_t total;
+                int64_t allocations;
+                int64_t reused;
+                int64_t operationPeak;
+                int64_t operationTotal;
+        };
+    }
+}
+#endif
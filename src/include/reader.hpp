@@ -17,7 +17,11 @@
 #ifndef KDB_PARQUET_READER
 #define KDB_PARQUET_READER
 
-#include <utils.hpp>
+#include <pool.hpp>
+#include <uring.hpp>
+#include <arrow/io/caching.h>
+#include <arrow/io/file.h>
+#include <arrow/util/future.h>
 #include <parquet/api/reader.h>
 
 using parquet::LogicalType;
@@ -30,22 +34,52 @@ namespace KDB{
                 PREADER();
                 ~PREADER();
 
-                static std::shared_ptr<parquet::ParquetFileReader> open_reader(const std::string& path);
+                static std::shared_ptr<parquet::ParquetFileReader> open_reader(const std::string& path, K props);
+                static std::vector<int> columnIndices(std::shared_ptr<parquet::ParquetFileReader> reader, K cols);
+                static int columnIndex(const parquet::SchemaDescriptor* schema, const std::string& name);
+                static std::string columnName(const parquet::ColumnDescriptor* descr);
+                static bool preBuffer(std::shared_ptr<parquet::ParquetFileReader> reader,
+                                      const std::vector<int>& rowGroups,
+                                      const std::vector<int>& columns,
+                                      K props);
+                static std::shared_ptr<parquet::ColumnReader> column(std::shared_ptr<parquet::RowGroupReader> row_group_reader,
+                                                                     int index);
+                //How a column is read into q, resolved once from its descriptor. Values are scaled then shifted
+                //onto the q epoch, kType is the type of a list's items for LIST columns
+                struct Decoder{
+                    K (*read)(parquet::ColumnReader* reader, int kType, int rowCount);
+                    int kType;
+                    int64_t scale;
+                    int64_t shift;
+                };
+                //Decoders for every leaf column of a schema
+                using Plan = std::vector<Decoder>;
+
+                static std::shared_ptr<const Plan> plan(const parquet::SchemaDescriptor* schema);
+                static Decoder decoder(const parquet::ColumnDescriptor* descr);
                 static K readColumns(std::shared_ptr<parquet::ColumnReader> column_reader, int rowCount);
+                static K readColumns(const Decoder& decoder, std::shared_ptr<parquet::ColumnReader> column_reader,
+                                     int rowCount);
 
-                template<typename T, typename F> 
-                static K getCol(T *reader, int rowCount, int kType, F func);
+                template<typename DType, typename V, int64_t Scale, int64_t Shift>
+                static Decoder numeric(int kType, bool list);
+                static K unsupported(parquet::ColumnReader *column_reader, int kType, int rowCount);
+                template<typename T, typename V>
+                static void readBatch(T *reader, V *values, int rowCount, V null);
+                template<typename DType, typename V, int64_t Scale, int64_t Shift>
+                static K getCol(parquet::ColumnReader *column_reader, int kType, int rowCount);
+                template<typename DType, typename V, int64_t Scale, int64_t Shift>
+                static K getListCol(parquet::ColumnReader *column_reader, int kType, int rowCount);
+                template<typename R, K (*Get)(R*, int, int)>
+                static K typed(parquet::ColumnReader *column_reader, int kType, int rowCount);
+                template<typename V>
+                static V null();
+                template<typename V, int64_t Scale, int64_t Shift, typename T>
+                static V convert(T value);
 
-                static K getBoolCol(parquet::BoolReader *reader, int kType, int rowCount);
-                static K getIntCol(parquet::Int32Reader *reader, int kType, int rowCount);
-                static K getDateCol(parquet::Int32Reader *reader, int kType, int rowCount);
                 static K getShortCol(parquet::Int32Reader *reader, int kType, int rowCount);
                 static std::vector<int32_t> extractShorts(parquet::Int32Reader *reader, int rowCount);
-                static K getLongCol(parquet::Int64Reader *reader, int kType, int rowCount);
-                static K getTimestampCol(parquet::Int64Reader *reader, int kType, int rowCount);
                 static K getInt96Col(parquet::Int96Reader *reader, int kType, int rowCount);
-                static K getFloatCol(parquet::FloatReader *reader, int kType, int rowCount);
-                static K getDoubleCol(parquet::DoubleReader *reader, int kType, int rowCount);
                 static K getByteCol(parquet::ByteArrayReader *reader, int kType, int rowCount);
                 static K getStringCol(parquet::ByteArrayReader *reader, int kType, int rowCount);
                 static K getSymCol(parquet::ByteArrayReader *reader, int kType, int rowCount);
@@ -53,6 +87,11 @@ namespace KDB{
                 #if KXVER>=3
                 static K getUUIDCol(parquet::FixedLenByteArrayReader *reader, int kType, int rowCount);
                 #endif
+
+                //Levels read per batch from a LIST column
+                static constexpr int64_t listBatch = 65536;
+                //Distinct schemas whose plans are kept
+                static constexpr size_t maxPlans = 64;
             private:
                 PREADER(const PREADER&) = delete;
                 void operator=(const PREADER&) = delete;
@@ -0,0 +1,48 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_SAMPLE
+#define KDB_PARQUET_SAMPLE
+
+#include <reader.hpp>
+#include <parquet/page_index.h>
+#include <random>
+
+namespace KDB{
+    namespace PARQ{
+        //Samples whole pages of a file at random. Pages are the unit because they are what gets
+        //decompressed and decoded, so pages that aren't picked are skipped unread in every column
+        class SAMPLE{
+            public:
+                //Rows of a row group that are read, from first
+                struct Range{
+                    int64_t first;
+                    int64_t rows;
+                };
+
+                static K run(const std::string& file, K cols, double fraction, J seed, K props);
+                static std::vector<int> columns(const parquet::SchemaDescriptor* schema, K cols);
+                static std::vector<Range> pick(std::shared_ptr<parquet::ParquetFileReader> reader, int rowGroup,
+                                               const std::vector<int>& columns, double fraction,
+                                               std::mt19937_64& random);
+                static std::vector<int64_t> pageRows(std::shared_ptr<parquet::ParquetFileReader> reader,
+                                                     int rowGroup, const std::vector<int>& columns);
+                static K read(std::shared_ptr<parquet::RowGroupReader> rowGroup, int index,
+                              const PREADER::Decoder& decoder, const std::vector<Range>& ranges);
+        };
+    }
+}
+#endif
@@ -0,0 +1,42 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_SORTER
+#define KDB_PARQUET_SORTER
+
+#include <writer.hpp>
+#include <threads.hpp>
+
+namespace KDB{
+    namespace PARQ{
+        class SORTER{
+            public:
+                struct Key{
+                    K col;
+                    K domain;
+                };
+
+                static K sortIndex(K table, K cols);
+                static std::vector<Key> sortKeys(K table, K cols);
+                static void releaseKeys(std::vector<Key>& keys);
+                static void parallelSort(J* index, J len, const std::vector<Key>& keys);
+                static bool lessThan(const std::vector<Key>& keys, J a, J b);
+                static int compare(const Key& key, J a, J b);
+                static bool sortable(K col);
+        };
+    }
+}
+#endif
@@ -0,0 +1,118 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_STATS
+#define KDB_PARQUET_STATS
+
+#include <utils.hpp>
+#include <arrow/io/interfaces.h>
+#include <arrow/util/future.h>
+#include <parquet/column_reader.h>
+#include <memory>
+#include <string>
+
+//Hot path instrumentation, compiled out entirely unless PARQ_STATS is defined
+#ifdef PARQ_STATS
+#define STATS_CAT_(a, b) a##b
+#define STATS_CAT(a, b) STATS_CAT_(a, b)
+#define STATS_COLUMN(op, name) KDB::PARQ::STATS::Column STATS_CAT(statsColumn, __LINE__){op, name}
+#define STATS_TIMER(stage) KDB::PARQ::STATS::Timer STATS_CAT(statsTimer, __LINE__){KDB::PARQ::STATS::stage}
+#define STATS_SPAN(name) KDB::PARQ::STATS::Span STATS_CAT(statsSpan, __LINE__){name}
+#define STATS_ADD(field, value) KDB::PARQ::STATS::add(&KDB::PARQ::STATS::Counters::field, value)
+#define STATS_TYPE(type) KDB::PARQ::STATS::setType(type)
+#else
+#define STATS_COLUMN(op, name)
+#define STATS_TIMER(stage)
+#define STATS_SPAN(name)
+#define STATS_ADD(field, value)
+#define STATS_TYPE(type)
+#endif
+
+namespace KDB{
+    namespace PARQ{
+        //Per-thread counters broken down by operation, column and q type. Threads only
+        //touch their own counters, which are summed when q asks for them.
+        class STATS{
+            public:
+                struct Counters{
+                    J calls = 0;
+                    J rows = 0;
+                    J bytes = 0;
+                    J pages = 0;
+                    J ioNs = 0;
+                    J decompressNs = 0;
+                    J decodeNs = 0;
+                    J encodeNs = 0;
+                    J convertNs = 0;
+                    J allocations = 0;
+                    J allocBytes = 0;
+                    J kObjects = 0;
+
+                    void add(const Counters& other);
+                };
+
+                //Each stage records its time less that of any stage nested inside it. Readers
+                //that convert values one at a time as they're decoded count the conversion under decode
+                enum Stage { io, decompress, decode, encode, convert };
+
+                //Attributes the work done on this thread to a column while in scope,
+                //an inner scope for the same thread is folded into the outer one
+                class Column{
+                    public:
+                        Column(const char* op, const std::string& name);
+                        ~Column();
+                    private:
+                        bool active;
+                        const char* op;
+                        std::string name;
+                        J start;
+                };
+
+                class Timer{
+                    public:
+                        explicit Timer(Stage stage);
+                        ~Timer();
+                    private:
+                        Stage stage;
+                        J start;
+                        J outer;
+                };
+
+                //A trace span, recorded only while tracing is on
+                class Span{
+                    public:
+                        explicit Span(const char* name);
+                        ~Span();
+                    private:
+                        const char* name;
+                        J start;
+                };
+
+                static void add(J Counters::* field, J value);
+                static void setType(int type);
+                static bool enabled();
+                static K table();
+                static void reset();
+                static void trace(bool on);
+                static void dump(const std::string& file);
+
+                //Wrap the file and page readers so IO, pages and decompression are counted
+                static std::shared_ptr<arrow::io::RandomAccessFile> file(std::shared_ptr<arrow::io::RandomAccessFile> source);
+                static std::unique_ptr<parquet::PageReader> pages(std::unique_ptr<parquet::PageReader> pager);
+        };
+    }
+}
+#endif
@@ -0,0 +1,110 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_STREAM
+#define KDB_PARQUET_STREAM
+
+#include <writer.hpp>
+#include <threads.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace KDB{
+    namespace PARQ{
+        class PSTREAM{
+            public:
+                //Values are held in their parquet physical form so the
+                //background thread never touches K objects
+                struct ColumnBuffer{
+                    int type;
+                    bool optional;
+                    //Type of the items of a LIST column, optional then refers to its elements
+                    int itemType;
+                    std::vector<int16_t> defLevels;
+                    std::vector<int16_t> repLevels;
+                    std::vector<uint8_t> values;
+                    std::vector<uint8_t> bytes;
+                    std::vector<uint32_t> lengths;
+                    std::vector<S> syms;
+                };
+
+                struct Buffer{
+                    std::vector<ColumnBuffer> columns;
+                    int64_t rows;
+                    int64_t bytes;
+                    std::chrono::steady_clock::time_point first;
+                };
+
+                PSTREAM(std::shared_ptr<parquet::ParquetFileWriter> fileWriter,
+                        std::shared_ptr<arrow::io::OutputStream> sink, K table,
+                        J maxRows, J maxBytes, J maxMillis);
+                ~PSTREAM();
+
+                static K open(std::string fileName, K table, parquet::Compression::type codec,
+                              K metadata, K props, K limits);
+                static K write(J handle, K table);
+                static K flush(J handle);
+                static K stats(J handle);
+                static K close(J handle);
+                static PSTREAM* getInstance(J handle);
+
+                static void appendColumn(ColumnBuffer& buffer, K col, J offset, J len);
+                static void appendList(ColumnBuffer& buffer, K col, J offset, J len);
+                template<typename P, typename V, typename IsNull, typename Convert>
+                static void appendValues(ColumnBuffer& buffer, const V* values, J len,
+                                         IsNull isNull, Convert convert);
+                static void appendSyms(ColumnBuffer& buffer, const S* syms, J len);
+                static void appendBytes(ColumnBuffer& buffer, const G* bytes, J len);
+                static void writeBuffer(ColumnBuffer& buffer, int64_t rows, parquet::ColumnWriter* writer);
+                static void clearBuffer(Buffer& buffer);
+                static void clearColumn(ColumnBuffer& buffer);
+
+                void append(K table);
+                void finish();
+                void enqueue(std::unique_lock<std::mutex>& lock);
+                void run();
+
+                std::shared_ptr<parquet::ParquetFileWriter> fileWriter_;
+                std::shared_ptr<arrow::io::OutputStream> sink_;
+                std::vector<S> names;
+                Buffer active;
+                Buffer pending;
+                bool hasPending;
+                bool stopping;
+                std::string error;
+                J maxRows;
+                J maxBytes;
+                J maxMillis;
+                J rowsWritten;
+                J rowGroups;
+                J waits;
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::thread worker;
+
+            private:
+                PSTREAM(const PSTREAM&) = delete;
+                void operator=(const PSTREAM&) = delete;
+
+                static std::map<J, PSTREAM*> instances;
+                static J nextHandle;
+        };
+    }
+}
+#endif
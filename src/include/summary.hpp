@@ -0,0 +1,57 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef KDB_PARQUET_SUMMARY
+#define KDB_PARQUET_SUMMARY
+
+#include <reader.hpp>
+#include <mutex>
+#include <optional>
+
+namespace KDB{
+    namespace PARQ{
+        //_metadata and _common_metadata summary files of a dataset directory. _metadata holds the
+        //footer of every file with each row group's file_path set, so a dataset is planned from one file
+        class SUMMARY{
+            public:
+                typedef std::vector<std::pair<std::string, std::shared_ptr<parquet::FileMetaData>>> Files;
+
+                static K write(const std::string& root, K props);
+                static K update(const std::string& root, K files, K props);
+                static void update(const std::string& root, const Files& files, K props = nullptr);
+                static void update(const std::string& fileName, std::shared_ptr<parquet::FileMetaData> metadata);
+                static K plan(const std::string& root, K filters, K props);
+
+                static std::shared_ptr<parquet::FileMetaData> load(const std::string& root, K props);
+                static std::vector<std::string> scan(const std::string& root);
+                static std::string relative(const std::string& root, const std::string& path);
+                static bool overlaps(const parquet::ColumnChunkMetaData& chunk, K range, J scale = 1);
+                static std::optional<J> integer(K range, J i, J scale = 1);
+                static std::optional<double> real(K range, J i);
+                static std::optional<std::string> bytes(K range, J i);
+                static void save(const std::string& root, const parquet::FileMetaData& metadata);
+
+                static const std::string metadataFile;
+                static const std::string commonFile;
+
+            private:
+                //Updates from concurrent writers in the process are applied one at a time
+                static std::mutex mutex;
+        };
+    }
+}
+#endif
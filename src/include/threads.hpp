@@ -0,0 +1,59 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_THREADS
+#define KDB_PARQUET_THREADS
+
+#include <utils.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace KDB{
+    namespace PARQ{
+        //Sizes Arrow's CPU and IO pools and the workers ParQ starts itself,
+        //so the library's parallelism can be fitted around q's own threads
+        class THREADS{
+            public:
+                //Marks a worker as busy for its lifetime, feeding the utilisation stats
+                class Busy{
+                    public:
+                        Busy();
+                        ~Busy();
+                    private:
+                        std::chrono::steady_clock::time_point start;
+                };
+
+                static void configure(int cpu, int io, int workers, const std::vector<int>& cpus);
+                static K stats();
+                static J workers();
+                static void pin();
+                static void enqueued(J count);
+
+            private:
+                static std::atomic<J> workerCount;
+                static std::atomic<J> running;
+                static std::atomic<J> queued;
+                static std::atomic<J> busyNanos;
+                static std::chrono::steady_clock::time_point since;
+                static std::vector<int> affinity;
+                static std::mutex mutex;
+        };
+    }
+}
+#endif
@@ -0,0 +1,47 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_TUNER
+#define KDB_PARQUET_TUNER
+
+#include <reader.hpp>
+#include <writer.hpp>
+#include <arrow/io/memory.h>
+#include <arrow/util/compression.h>
+
+namespace KDB{
+    namespace PARQ{
+        class TUNER{
+            public:
+                struct Trial{
+                    parquet::Encoding::type encoding;
+                    bool dictionary;
+                    parquet::Compression::type codec;
+                    J level;
+                    int64_t bytes;
+                    double encodeSeconds;
+                    double decodeSeconds;
+                };
+
+                static K tune(K table, std::string goal, double floor, K codecs, K levels, K props);
+                static Trial tuneColumn(K name, K col, std::string goal, double floor, K codecs, K levels, K props);
+                static bool runTrial(K names, K values, K props, Trial& trial);
+                static std::vector<std::pair<parquet::Encoding::type, bool>> encodings(Type::type physicalType);
+                static J sampleBytes(K col);
+        };
+    }
+}
+#endif
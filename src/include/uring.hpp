@@ -0,0 +1,119 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KDB_PARQUET_URING
+#define KDB_PARQUET_URING
+
+#include <utils.hpp>
+#include <arrow/buffer.h>
+#include <arrow/io/interfaces.h>
+#include <arrow/memory_pool.h>
+#include <arrow/util/future.h>
+#include <memory>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace KDB{
+    namespace PARQ{
+        //A minimal io_uring submission/completion ring on the raw syscalls, one per thread
+        class URING{
+            public:
+                struct Request{
+                    int opcode;
+                    int fd;
+                    void* buffer;
+                    unsigned length;
+                    int64_t offset;
+                    int64_t result;
+                };
+
+                explicit URING(unsigned entries);
+                ~URING();
+
+                static bool available();
+                static URING& local(unsigned entries);
+                //Keeps up to the ring's depth of requests in flight until every one completes
+                void run(std::vector<Request>& requests);
+
+            private:
+                URING(const URING&) = delete;
+                void operator=(const URING&) = delete;
+                void release();
+
+                int fd;
+                unsigned entries;
+                void* sqRing;
+                void* cqRing;
+                size_t sqSize;
+                size_t cqSize;
+                io_uring_sqe* sqes;
+                size_t sqesSize;
+                unsigned* sqHead;
+                unsigned* sqTail;
+                unsigned* sqMask;
+                unsigned* sqArray;
+                unsigned* cqHead;
+                unsigned* cqTail;
+                unsigned* cqMask;
+                io_uring_cqe* cqes;
+        };
+
+        //Reads a file through io_uring, splitting each range into blocks submitted together so
+        //scattered column chunks are read at a high queue depth, optionally bypassing the page cache
+        class URINGFILE : public arrow::io::RandomAccessFile{
+            public:
+                //Falls back to Arrow's pread based file when io_uring can't be used
+                static arrow::Result<std::shared_ptr<arrow::io::RandomAccessFile>> Open(const std::string& path,
+                                                                                        bool direct,
+                                                                                        int64_t depth,
+                                                                                        int64_t blockSize,
+                                                                                        arrow::MemoryPool* pool);
+                ~URINGFILE() override;
+
+                arrow::Status Close() override;
+                bool closed() const override;
+                arrow::Result<int64_t> Tell() const override;
+                arrow::Status Seek(int64_t position) override;
+                arrow::Result<int64_t> GetSize() override;
+                arrow::Result<int64_t> Read(int64_t nbytes, void* out) override;
+                arrow::Result<std::shared_ptr<arrow::Buffer>> Read(int64_t nbytes) override;
+                arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes, void* out) override;
+                arrow::Result<std::shared_ptr<arrow::Buffer>> ReadAt(int64_t position, int64_t nbytes) override;
+                std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>> ReadManyAsync(
+                    const arrow::io::IOContext& ctx, const std::vector<arrow::io::ReadRange>& ranges) override;
+
+                //O_DIRECT offsets, lengths and buffers are aligned to this
+                static constexpr int64_t directAlignment = 4096;
+
+            private:
+                URINGFILE(int fd, bool direct, int64_t size, unsigned depth, int64_t blockSize, arrow::MemoryPool* pool);
+                arrow::Result<std::vector<std::shared_ptr<arrow::Buffer>>> readMany(
+                    const std::vector<arrow::io::ReadRange>& ranges);
+                arrow::Status readBlock(uint8_t* buffer, int64_t length, int64_t offset, int64_t done);
+
+                int fd;
+                bool direct;
+                int64_t size;
+                unsigned depth;
+                int64_t blockSize;
+                int64_t position;
+                arrow::MemoryPool* pool;
+        };
+    }
+}
+#endif
@@ -34,6 +34,10 @@ extern"C"{
     std::string k2string(K x);
     std::vector<std::string> k2StrVec(K x);
     K string2k(std::string x);
+    J dictIndex(K dict, std::string key);
+    K dictGet(K dict, std::string key);
+    J dictLong(K dict, std::string key, J fallback);
+    B dictBool(K dict, std::string key, B fallback);
 }
 
 inline const B* kB(const k0* x){ return reinterpret_cast<const B*>(x->G0); }
@@ -17,10 +17,15 @@
 #ifndef KDB_PARQUET_WRITER
 #define KDB_PARQUET_WRITER
 
-#include <utils.hpp>
+#include <pool.hpp>
+#include <asyncfile.hpp>
+#include <arrow/array.h>
+#include <arrow/builder.h>
 #include <arrow/io/file.h>
+#include <arrow/util/bit_util.h>
 #include <arrow/util/key_value_metadata.h>
 #include <parquet/api/writer.h>
+#include <optional>
 
 using parquet::LogicalType;
 using parquet::Repetition;
@@ -32,14 +37,43 @@ namespace KDB{
     namespace PARQ{
         class WRITER{
             public:
+                //Options of one column from the columns property, nj or empty when not set.
+                //Read on q's main thread so writers on other threads don't touch q objects for them
+                struct ColumnOption{
+                    std::string name;
+                    J encoding = nj;
+                    std::optional<bool> dictionary;
+                    J codec = nj;
+                    J compressionLevel = nj;
+                };
+
                 static std::shared_ptr<arrow::KeyValueMetadata> KeyValueMetadata(K metadata);
+                static std::vector<ColumnOption> ColumnOptions(K props);
+                static std::shared_ptr<parquet::WriterProperties> WriterProperties(parquet::Compression::type codec,
+                                                                                   K props,
+                                                                                   const std::vector<ColumnOption>& columns,
+                                                                                   std::shared_ptr<GroupNode> schema);
+                static void FileProperties(parquet::WriterProperties::Builder& builder,
+                                           parquet::Compression::type codec,
+                                           K props);
+                static void ColumnProperties(parquet::WriterProperties::Builder& builder,
+                                             const ColumnOption& column);
                 static std::shared_ptr<parquet::ParquetFileWriter> OpenFile(std::string fileName,
                                                                             std::shared_ptr<GroupNode> schema, 
                                                                             parquet::Compression::type codec, 
                                                                             bool append, 
-                                                                            K metadata);
-                static std::shared_ptr<GroupNode> SetupSchema(K names, K values, int numCols);
-                static parquet::schema::NodePtr k2parquet(const std::string& name, int type, int firstType);
+                                                                            K metadata,
+                                                                            K props,
+                                                                            const std::vector<ColumnOption>& columns,
+                                                                            std::shared_ptr<arrow::io::OutputStream>& sink);
+                static void CloseFile(std::shared_ptr<parquet::ParquetFileWriter> writer,
+                                      std::shared_ptr<arrow::io::OutputStream> sink);
+                static std::shared_ptr<arrow::io::OutputStream> OpenStream(const std::string& fileName, bool append, K props);
+                static std::shared_ptr<GroupNode> SetupSchema(K names, K values, int numCols, bool nullable);
+                static parquet::schema::NodePtr k2parquet(const std::string& name, int type, int firstType, bool nullable);
+                static parquet::schema::NodePtr listNode(const std::string& name, int itemType, bool nullable);
+                static int listType(K col);
+                static bool hasNull(int type);
 
                 template<typename T, typename T1>static void writeCol(T writer, int len, T1 col);
                 //static void writeCol(parquet::BoolWriter* writer, int len, B* col);
@@ -53,11 +87,23 @@ namespace KDB{
                 static void writeCol(parquet::Int96Writer* writer, K col);
                 static void writeCharCol(parquet::ByteArrayWriter* writer, K col);
                 static void writeSymCol(parquet::ByteArrayWriter* writer, K col);
+                static void writeEnumCol(parquet::ColumnWriter* writer, K col);
+                static K enumDomain(K col);
                 static void writeCol(parquet::ByteArrayWriter* writer, K col);
                 static void writeColumn(K col, parquet::RowGroupWriter* rg_writer);
-                static std::vector<parquet::ByteArray> byteToVec(K col);
-                static std::vector<parquet::ByteArray> stringToVec(K col);
-                static std::vector<parquet::ByteArray> kToVec(K col);
+                static void writeOptionalColumn(K col, parquet::ColumnWriter* writer);
+                static void writeListColumn(K col, parquet::ColumnWriter* writer);
+                template<typename DType, typename V, typename IsNull, typename Convert>
+                static void writeListCol(parquet::ColumnWriter* writer, K col, IsNull isNull, Convert convert);
+                template<typename DType, typename V, typename IsNull, typename Convert>
+                static void writeOptionalCol(parquet::ColumnWriter* writer, const V* values, J len,
+                                             IsNull isNull, Convert convert);
+                static uint8_t* scratch(size_t bytes);
+                template<typename DType, typename V, typename Convert>
+                static void writeChunked(parquet::ColumnWriter* writer, const V* values, J len, Convert convert);
+
+                //Rows converted per WriteBatch, so the scratch space doesn't grow with the column
+                static constexpr J chunkRows = 65536;
         };
     }
 }
@@ -19,35 +19,48 @@
 using namespace KDB::PARQ;
 
 extern"C"{
-    K readGroup(K filename, K group, K cols){
+    K readGroup(K filename, K group, K cols, K props){
         if(filename->t!=KC && filename->t!=-KS)
             return kerror("File name must be a string/symbol");
         if(group->t!=-KJ)
             return kerror("Group must be a long");
         if(cols->t!=KS && cols->n != 0)
             return kerror("Cols must be a list of symbols");
-        return PKDB::readGroup(k2string(filename), group->j, cols);
+        if(props->t!=XD && props->n != 0)
+            return kerror("Options must be a dictionary");
+        POOL::getInstance().begin();
+        return PKDB::readGroup(k2string(filename), group->j, cols, props);
     }
 
-    K initReader(K filename){
+    K initReader(K filename, K props){
         if(filename->t!=KC && filename->t!=-KS)
             return kerror("File name must be a string/symbol");
-        return PKDB::loadReader(k2string(filename));
+        if(props->t!=XD && props->n != 0)
+            return kerror("Options must be a dictionary");
+        POOL::getInstance().begin();
+        return PKDB::loadReader(k2string(filename), props);
     }
 
-    K readMulti(K cols){
+    K readMulti(K cols, K props){
         if(cols->t!=KS && cols->n != 0)
             return kerror("Cols must be a list of symbols");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Options must be a dictionary");
 
         auto instance = &PKDB::getInstance();
         if(!instance)
 			return kerror("Parquet file not loaded");
 
+        POOL::getInstance().begin();
         try {
+            if(PREADER::preBuffer(instance->filerReader_, {instance->currentRowGroup},
+                                  PREADER::columnIndices(instance->filerReader_, cols), props))
+                instance->row_group_reader = instance->filerReader_->RowGroup(instance->currentRowGroup);
             return instance->readTable(instance->row_group_reader, 
                                     	cols->n ? cols->n : instance->numColumns, 
 										instance->numRows, 
-										cols);
+										cols,
+										*instance->plan_);
         } catch (const std::exception& e) {
             return orr(const_cast<char*>(e.what()));
         }
@@ -115,7 +128,7 @@ extern"C"{
         return kj(instance->totalRowGroups);
     }
 
-    K writer(K table, K filename, K single, K codec, K metadata){
+    K writer(K table, K filename, K single, K codec, K metadata, K props){
         if(filename->t!=KC && filename->t!=-KS)
             return kerror("File name must be a string/symbol");
         if(single->t!=-KB)
@@ -124,8 +137,40 @@ extern"C"{
             return kerror("Codec must be a long");
         if(metadata->t!=XD && metadata->n != 0)
             return kerror("metadata must be a dictionary");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Properties must be a dictionary");
+        POOL::getInstance().begin();
         return PWRITE::write(table, k2string(filename), single->g, 
-                             parquet::Compression::type(codec->j), false, metadata);
+                             parquet::Compression::type(codec->j), false, metadata, props);
+    }
+
+    K appendFile(K table, K filename, K single, K codec, K props){
+        if(table->t!=XT)
+            return kerror("Table must be an unkeyed table");
+        if(filename->t!=KC && filename->t!=-KS)
+            return kerror("File name must be a string/symbol");
+        if(single->t!=-KB)
+            return kerror("Single must be a bool");
+        if(codec->t!=-KJ)
+            return kerror("Codec must be a long");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Properties must be a dictionary");
+        POOL::getInstance().begin();
+        K metadata = ktn(KS, 0);
+        K res = PWRITE::write(table, k2string(filename), single->g,
+                              parquet::Compression::type(codec->j), true, metadata, props);
+        r0(metadata);
+        return res;
+    }
+
+    K recoverFile(K filename){
+        if(filename->t!=KC && filename->t!=-KS)
+            return kerror("File name must be a string/symbol");
+        try{
+            return kb(APPEND::recover(k2string(filename)));
+        }catch (const std::exception& e){
+            return orr(const_cast<char*>(e.what()));
+        }
     }
 
     K closeW(K /*x*/){
@@ -137,4 +182,335 @@ extern"C"{
             return orr(const_cast<char*>(e.what()));
         }
     }
+
+    K tune(K table, K goal, K floor, K codecs, K levels, K props){
+        if(table->t!=XT)
+            return kerror("Table must be an unkeyed table");
+        if(goal->t!=-KS)
+            return kerror("Goal must be a sym");
+        if(floor->t!=-KF)
+            return kerror("Floor must be a float");
+        if(codecs->t!=KJ || levels->t!=KJ || codecs->n!=levels->n)
+            return kerror("Codecs and levels must be long lists of equal length");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Properties must be a dictionary");
+        std::string g {goal->s};
+        if(g!="smallest" && g!="fastest" && g!="throughput")
+            return kerror("Goal must be one of smallest, fastest, throughput");
+        POOL::getInstance().begin();
+        try {
+            return TUNER::tune(table, g, floor->f, codecs, levels, props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K sortIndex(K table, K cols){
+        if(table->t!=XT)
+            return kerror("Table must be an unkeyed table");
+        if(cols->t!=KS)
+            return kerror("Cols must be a list of symbols");
+        try {
+            return SORTER::sortIndex(table, cols);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K partitioned(K table, K root, K partCols, K codec, K metadata, K props){
+        if(table->t!=XT)
+            return kerror("Table must be an unkeyed table");
+        if(root->t!=KC && root->t!=-KS)
+            return kerror("Root directory must be a string/symbol");
+        if(partCols->t!=KS || !partCols->n)
+            return kerror("Partition columns must be a list of symbols");
+        if(codec->t!=-KJ)
+            return kerror("Codec must be a long");
+        if(metadata->t!=XD && metadata->n != 0)
+            return kerror("metadata must be a dictionary");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Properties must be a dictionary");
+        POOL::getInstance().begin();
+        try {
+            return PARTITION::write(table, k2string(root), partCols, parquet::Compression::type(codec->j),
+                                    metadata, props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K exportHdb(K root, K parts, K files, K codec, K metadata, K props){
+        if(root->t!=KC && root->t!=-KS)
+            return kerror("HDB root must be a string/symbol");
+        if(parts->t!=0 || files->t!=0 || parts->n!=files->n)
+            return kerror("Partitions and files must be lists of strings of equal length");
+        for(J i=0;i<parts->n;i++)
+            if(kK(parts)[i]->t!=KC || kK(files)[i]->t!=KC)
+                return kerror("Partitions and files must be lists of strings of equal length");
+        if(codec->t!=-KJ)
+            return kerror("Codec must be a long");
+        if(metadata->t!=XD && metadata->n != 0)
+            return kerror("metadata must be a dictionary");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Properties must be a dictionary");
+        POOL::getInstance().begin();
+        try {
+            return EXPORTER::exportHdb(k2string(root), parts, files, parquet::Compression::type(codec->j),
+                                       metadata, props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K aggregate(K filename, K by, K aggs, K filters, K props){
+        if(filename->t!=KC && filename->t!=-KS)
+            return kerror("File name must be a string/symbol");
+        if(by->t!=XD || (kK(by)[0]->n && kK(by)[0]->t!=KS))
+            return kerror("By must be a dictionary of names to columns");
+        if(aggs->t!=XD || kK(aggs)[0]->t!=KS || !kK(aggs)[0]->n)
+            return kerror("Aggregations must be a dictionary of names to function and column");
+        if(filters->t!=XD || (kK(filters)[0]->n && (kK(filters)[0]->t!=KS || kK(filters)[1]->t!=0)))
+            return kerror("Filters must be a dictionary of columns to lower and upper bounds");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Options must be a dictionary");
+        POOL::getInstance().begin();
+        try {
+            return AGGREGATE::run(k2string(filename), by, aggs, filters, props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K sample(K filename, K cols, K fraction, K seed, K props){
+        if(filename->t!=KC && filename->t!=-KS)
+            return kerror("File name must be a string/symbol");
+        if(cols->t!=KS && cols->n != 0)
+            return kerror("Cols must be a list of symbols");
+        if(fraction->t!=-KF || !(fraction->f > 0 && fraction->f <= 1))
+            return kerror("Fraction must be a float above 0 and at most 1");
+        if(seed->t!=-KJ)
+            return kerror("Seed must be a long");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Options must be a dictionary");
+        POOL::getInstance().begin();
+        try {
+            return SAMPLE::run(k2string(filename), cols, fraction->f, seed->j, props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K readBytes(K bytes, K group, K cols){
+        if(bytes->t!=KG)
+            return kerror("Bytes must be a byte vector");
+        if(group->t!=-KJ)
+            return kerror("Group must be a long");
+        if(cols->t!=KS && cols->n != 0)
+            return kerror("Cols must be a list of symbols");
+        POOL::getInstance().begin();
+        try {
+            return BYTES::read(bytes, group->j, cols);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K writeBytes(K tables, K codec, K metadata, K props){
+        if(tables->t!=0 || !tables->n)
+            return kerror("Tables must be a list of tables");
+        for(J i=0;i<tables->n;i++)
+            if(kK(tables)[i]->t!=XT)
+                return kerror("Tables must be a list of tables");
+        if(codec->t!=-KJ)
+            return kerror("Codec must be a long");
+        if(metadata->t!=XD && metadata->n != 0)
+            return kerror("metadata must be a dictionary");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Properties must be a dictionary");
+        POOL::getInstance().begin();
+        try {
+            return BYTES::write(tables, parquet::Compression::type(codec->j), metadata, props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K summaryWrite(K root, K props){
+        if(root->t!=KC && root->t!=-KS)
+            return kerror("Root directory must be a string/symbol");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Options must be a dictionary");
+        POOL::getInstance().begin();
+        try {
+            return SUMMARY::write(k2string(root), props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K summaryUpdate(K root, K files, K props){
+        if(root->t!=KC && root->t!=-KS)
+            return kerror("Root directory must be a string/symbol");
+        if(files->t!=KS && files->t!=0)
+            return kerror("Files must be a list of symbols/strings");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Options must be a dictionary");
+        POOL::getInstance().begin();
+        try {
+            return SUMMARY::update(k2string(root), files, props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K datasetPlan(K root, K filters, K props){
+        if(root->t!=KC && root->t!=-KS)
+            return kerror("Root directory must be a string/symbol");
+        if(filters->t!=XD || (kK(filters)[0]->n && (kK(filters)[0]->t!=KS || kK(filters)[1]->t!=0)))
+            return kerror("Filters must be a dictionary of columns to lower and upper bounds");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Options must be a dictionary");
+        POOL::getInstance().begin();
+        try {
+            return SUMMARY::plan(k2string(root), filters, props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K compact(K inputs, K outputs, K target, K codec, K props){
+        if(inputs->t!=KS && inputs->t!=0)
+            return kerror("Inputs must be a list of files");
+        if(outputs->t!=KC && outputs->t!=-KS && outputs->t!=KS && outputs->t!=0)
+            return kerror("Output must be a string/symbol or a list of them");
+        if(target->t!=-KJ)
+            return kerror("Row group size must be a long");
+        if(codec->t!=-KJ)
+            return kerror("Codec must be a long");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Properties must be a dictionary");
+        POOL::getInstance().begin();
+        try {
+            return COMPACT::run(inputs, outputs, target->j, parquet::Compression::type(codec->j), props);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K streamOpen(K table, K filename, K codec, K metadata, K props, K limits){
+        if(table->t!=XT)
+            return kerror("Table must be an unkeyed table");
+        if(filename->t!=KC && filename->t!=-KS)
+            return kerror("File name must be a string/symbol");
+        if(codec->t!=-KJ)
+            return kerror("Codec must be a long");
+        if(metadata->t!=XD && metadata->n != 0)
+            return kerror("metadata must be a dictionary");
+        if(props->t!=XD && props->n != 0)
+            return kerror("Properties must be a dictionary");
+        if(limits->t!=XD && limits->n != 0)
+            return kerror("Limits must be a dictionary");
+        return PSTREAM::open(k2string(filename), table, parquet::Compression::type(codec->j),
+                             metadata, props, limits);
+    }
+
+    K streamWrite(K handle, K table){
+        if(handle->t!=-KJ)
+            return kerror("Handle must be a long");
+        if(table->t!=XT)
+            return kerror("Table must be an unkeyed table");
+        return PSTREAM::write(handle->j, table);
+    }
+
+    K streamFlush(K handle){
+        if(handle->t!=-KJ)
+            return kerror("Handle must be a long");
+        return PSTREAM::flush(handle->j);
+    }
+
+    K streamStats(K handle){
+        if(handle->t!=-KJ)
+            return kerror("Handle must be a long");
+        return PSTREAM::stats(handle->j);
+    }
+
+    K streamClose(K handle){
+        if(handle->t!=-KJ)
+            return kerror("Handle must be a long");
+        return PSTREAM::close(handle->j);
+    }
+
+    K memoryConfigure(K limit, K cacheLimit, K cacheMin){
+        if(limit->t!=-KJ || cacheLimit->t!=-KJ || cacheMin->t!=-KJ)
+            return kerror("Limits must be longs");
+        if(limit->j<0 || cacheLimit->j<0 || cacheMin->j<0)
+            return kerror("Limits can't be negative");
+        POOL::getInstance().configure(limit->j, cacheLimit->j, cacheMin->j);
+        return kb(1);
+    }
+
+    K memoryStats(K /*x*/){
+        return POOL::getInstance().stats();
+    }
+
+    K memoryRelease(K /*x*/){
+        POOL::getInstance().ReleaseUnused();
+        return kb(1);
+    }
+
+    K threadsConfigure(K cpu, K io, K workers, K affinity){
+        if(cpu->t!=-KJ || io->t!=-KJ || workers->t!=-KJ)
+            return kerror("Thread counts must be longs");
+        if(cpu->j<1 || io->j<1 || workers->j<1)
+            return kerror("Thread counts must be positive");
+        if(affinity->t!=KJ && affinity->n != 0)
+            return kerror("Affinity must be a list of longs");
+        std::vector<int> cpus;
+        for(J i=0;i<affinity->n;i++){
+            if(kJ(affinity)[i]<0 || kJ(affinity)[i]>=CPU_SETSIZE)
+                return kerror("Affinity cpus out of range");
+            cpus.push_back(kJ(affinity)[i]);
+        }
+        try {
+            THREADS::configure(cpu->j, io->j, workers->j, cpus);
+            return kb(1);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K threadsStats(K /*x*/){
+        return THREADS::stats();
+    }
+
+    K statsTable(K /*x*/){
+        return STATS::table();
+    }
+
+    K statsReset(K /*x*/){
+        STATS::reset();
+        return kb(1);
+    }
+
+    K statsTrace(K on){
+        if(on->t!=-KB)
+            return kerror("Trace flag must be a boolean");
+        try {
+            STATS::trace(on->g);
+            return kb(1);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
+
+    K statsDump(K filename){
+        if(filename->t!=KC && filename->t!=-KS)
+            return kerror("File name must be a string/symbol");
+        try {
+            STATS::dump(k2string(filename));
+            return kb(1);
+        } catch (const std::exception& e) {
+            return orr(const_cast<char*>(e.what()));
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,704 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <aggregate.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+using namespace KDB::PARQ;
+
+namespace{
+    const J batchSize = 65536;
+
+    const std::vector<std::string> functionNames {"count", "sum", "min", "max", "first", "last", "avg"};
+
+    void append(std::string& key, const void* data, size_t size){
+        key.append(static_cast<const char*>(data), size);
+    }
+
+    //Whether the value sorts before another as q sorts, nulls first
+    int compare(double a, double b){
+        if(std::isnan(a) || std::isnan(b))
+            return std::isnan(b) - std::isnan(a);
+        return (a > b) - (a < b);
+    }
+}
+
+K AGGREGATE::run(const std::string& file, K by, K aggs, K filters, K props){
+    STATS_SPAN("aggregate");
+    std::shared_ptr<parquet::ParquetFileReader> reader = PREADER::open_reader(file, props);
+    std::shared_ptr<parquet::FileMetaData> metadata = reader->metadata();
+    Plan plan = AGGREGATE::plan(metadata->schema(), by, aggs, filters);
+
+    //Row groups outside the filters are skipped, and those the statistics answer aren't read
+    int groups = metadata->num_row_groups();
+    std::vector<Partial> partials(groups);
+    std::vector<int> reads;
+    for(int i=0;i<groups;i++){
+        std::unique_ptr<parquet::RowGroupMetaData> rowGroup = metadata->RowGroup(i);
+        bool keep = true;
+        for(size_t j=0;keep && j<plan.filters.size();j++)
+            keep = SUMMARY::overlaps(*rowGroup->ColumnChunk(plan.columns[plan.filters[j].column].index),
+                                     plan.filters[j].range, plan.columns[plan.filters[j].column].scale);
+        if(keep && !fromStatistics(*rowGroup, plan, partials[i]))
+            reads.push_back(i);
+    }
+
+    std::vector<int> indices;
+    for(auto& column : plan.columns)
+        indices.push_back(column.index);
+    PREADER::preBuffer(reader, reads, indices, props);
+
+    std::atomic<size_t> next {0};
+    std::mutex mutex;
+    std::string error;
+    auto work = [&](){
+        THREADS::Busy busy;
+        for(size_t i=next++;i<reads.size();i=next++){
+            try{
+                scan(reader->RowGroup(reads[i]), plan, partials[reads[i]]);
+            }catch(const std::exception& e){
+                std::lock_guard<std::mutex> lock(mutex);
+                if(error.empty())
+                    error = e.what();
+                next = reads.size();
+            }
+        }
+    };
+    J threads = std::min<J>(THREADS::workers(), reads.size());
+    //Run inline on q's main thread, which is left unpinned
+    if(threads <= 1)
+        work();
+    else{
+        std::vector<std::thread> workers;
+        for(J i=0;i<threads;i++)
+            workers.emplace_back([&](){
+                THREADS::pin();
+                work();
+            });
+        for(auto& worker : workers)
+            worker.join();
+    }
+    if(!error.empty())
+        throw std::runtime_error(error);
+
+    //Merged in row group order, which keeps first and last in file order
+    Partial total;
+    for(auto& partial : partials)
+        merge(total, partial, plan);
+    return result(plan, total, by, aggs);
+}
+
+AGGREGATE::Plan AGGREGATE::plan(const parquet::SchemaDescriptor* schema, K by, K aggs, K filters){
+    Plan plan;
+    K byNames = kK(by)[0];
+    K bySpecs = kK(by)[1];
+    for(J i=0;i<byNames->n;i++){
+        //A column, or a column and the width of its buckets
+        K spec = bySpecs->t == KS ? nullptr : kK(bySpecs)[i];
+        if(spec && spec->t != -KS && (spec->t != 0 || spec->n != 2 || kK(spec)[0]->t != -KS))
+            throw std::runtime_error(std::string{"by must be a column or a column and bucket width: "} + kS(byNames)[i]);
+        std::string name = !spec ? kS(bySpecs)[i] : spec->t == -KS ? spec->s : kK(spec)[0]->s;
+        By entry {column(plan, schema, name), 0, 0};
+        const Column& col = plan.columns[entry.column];
+        if(spec && spec->t == 0){
+            K width = kK(spec)[1];
+            if(col.lane == text)
+                throw std::runtime_error("Can't bucket a symbol column: " + name);
+            if(width->t == -KF || width->t == -KE)
+                entry.realWidth = width->t == -KF ? width->f : width->e;
+            else if(width->t == -KJ || width->t == -KN)
+                entry.width = width->j;
+            else if(width->t == -KI || width->t == -KT || width->t == -KU || width->t == -KV)
+                entry.width = width->i;
+            else if(width->t == -KH)
+                entry.width = width->h;
+            else
+                throw std::runtime_error("Bucket width must be a number or timespan: " + name);
+            //Widths given as a timespan, minute or second are brought into the column's units
+            J nanos = width->t == -KN ? 1 : width->t == -KU ? 60000000000 : width->t == -KV ? 1000000000 : 0;
+            if(nanos && col.type == KT)
+                entry.width = entry.width * nanos / 1000000;
+            else if(nanos && col.type != KP && col.type != KN)
+                throw std::runtime_error("Bucket width of " + name + " must be a number");
+            else if(nanos)
+                entry.width *= nanos;
+            if(col.lane == real && !entry.realWidth)
+                entry.realWidth = entry.width;
+            if(entry.width < 0 || entry.realWidth < 0 || (!entry.width && !entry.realWidth))
+                throw std::runtime_error("Bucket width must be positive: " + name);
+        }
+        plan.by.push_back(entry);
+    }
+
+    K aggSpecs = kK(aggs)[1];
+    for(J i=0;i<kK(aggs)[0]->n;i++){
+        K spec = aggSpecs->t == 0 ? kK(aggSpecs)[i] : nullptr;
+        if(!spec || spec->t != KS || spec->n != 2)
+            throw std::runtime_error(std::string{"Aggregation must be a function and column: "} + kS(kK(aggs)[0])[i]);
+        auto function = std::find(functionNames.begin(), functionNames.end(), kS(spec)[0]);
+        if(function == functionNames.end())
+            throw std::runtime_error(std::string{"Unknown aggregation: "} + kS(spec)[0]);
+        Agg agg {Function(function - functionNames.begin()), column(plan, schema, kS(spec)[1])};
+        if(plan.columns[agg.column].lane == text && agg.function != count && agg.function != first && agg.function != last)
+            throw std::runtime_error(std::string{"Only count, first and last apply to symbol column "} + kS(spec)[1]);
+        plan.aggs.push_back(agg);
+    }
+
+    K filterNames = kK(filters)[0];
+    for(J i=0;i<filterNames->n;i++){
+        K range = kK(kK(filters)[1])[i];
+        if(range->n != 2)
+            throw std::runtime_error("Filters must be a lower and upper bound");
+        Filter filter {};
+        filter.column = column(plan, schema, kS(filterNames)[i]);
+        filter.range = range;
+        switch(plan.columns[filter.column].lane){
+            case integer:
+                //Compared with stored values, before they're scaled and shifted
+                filter.low = SUMMARY::integer(range, 0, plan.columns[filter.column].scale);
+                filter.high = SUMMARY::integer(range, 1, plan.columns[filter.column].scale);
+                break;
+            case real:
+                filter.realLow = SUMMARY::real(range, 0);
+                filter.realHigh = SUMMARY::real(range, 1);
+                break;
+            case text:
+                filter.textLow = SUMMARY::bytes(range, 0);
+                filter.textHigh = SUMMARY::bytes(range, 1);
+                break;
+        }
+        plan.filters.push_back(filter);
+    }
+    return plan;
+}
+
+int AGGREGATE::column(Plan& plan, const parquet::SchemaDescriptor* schema, const std::string& name){
+    for(size_t i=0;i<plan.columns.size();i++)
+        if(plan.columns[i].name == name)
+            return i;
+    int index = schema->ColumnIndex(name);
+    if(index < 0)
+        throw std::runtime_error("Column not in file: " + name);
+    const parquet::ColumnDescriptor* descr = schema->Column(index);
+    if(descr->max_repetition_level())
+        throw std::runtime_error("Can't aggregate the nested column " + name);
+    //Read as readColumns would, byte arrays of any kind are compared as text
+    PREADER::Decoder decoder = PREADER::decoder(descr);
+    Type::type physical = descr->physical_type();
+    if(physical == Type::INT96 || physical == Type::FIXED_LEN_BYTE_ARRAY)
+        throw std::runtime_error("Can't aggregate the column " + name + " of type " + parquet::TypeToString(physical));
+    int type = physical == Type::BYTE_ARRAY ? KS : decoder.kType;
+    Lane lane = type == KS ? text : type == KE || type == KF ? real : integer;
+    plan.columns.push_back({index, name, type, lane, decoder.scale, decoder.shift});
+    return plan.columns.size() - 1;
+}
+
+bool AGGREGATE::fromStatistics(const parquet::RowGroupMetaData& rowGroup, const Plan& plan, Partial& partial){
+    //Without grouping, a row group every filter keeps whole gives count, min and max from its footer
+    if(!plan.by.empty())
+        return false;
+    auto range = [&rowGroup](const Column& column, J& low, J& high, double& realLow, double& realHigh){
+        std::unique_ptr<parquet::ColumnChunkMetaData> chunk = rowGroup.ColumnChunk(column.index);
+        std::shared_ptr<parquet::Statistics> stats = chunk->is_stats_set() ? chunk->statistics() : nullptr;
+        if(!stats || !stats->HasMinMax() || !stats->HasNullCount() || stats->null_count())
+            return false;
+        //REQUIRED columns hold q's integer nulls as values, which the statistics count but scan skips
+        switch(stats->physical_type()){
+            case Type::INT32:{
+                auto typed = std::static_pointer_cast<parquet::Int32Statistics>(stats);
+                low = typed->min();
+                high = typed->max();
+                return low != null(column.type) && high != null(column.type);
+            }
+            case Type::INT64:{
+                auto typed = std::static_pointer_cast<parquet::Int64Statistics>(stats);
+                low = typed->min();
+                high = typed->max();
+                return low != null(column.type) && high != null(column.type);
+            }
+            case Type::FLOAT:{
+                auto typed = std::static_pointer_cast<parquet::FloatStatistics>(stats);
+                realLow = typed->min();
+                realHigh = typed->max();
+                return true;
+            }
+            case Type::DOUBLE:{
+                auto typed = std::static_pointer_cast<parquet::DoubleStatistics>(stats);
+                realLow = typed->min();
+                realHigh = typed->max();
+                return true;
+            }
+            default:
+                return false;
+        }
+    };
+    J low, high;
+    double realLow, realHigh;
+    for(auto& filter : plan.filters){
+        if(!range(plan.columns[filter.column], low, high, realLow, realHigh))
+            return false;
+        bool inside = plan.columns[filter.column].lane == integer ?
+                      (!filter.low || *filter.low <= low) && (!filter.high || high <= *filter.high) :
+                      (!filter.realLow || *filter.realLow <= realLow) && (!filter.realHigh || realHigh <= *filter.realHigh);
+        if(!inside)
+            return false;
+    }
+    std::vector<Acc> accs(plan.aggs.size());
+    for(size_t i=0;i<plan.aggs.size();i++){
+        const Agg& agg = plan.aggs[i];
+        const Column& column = plan.columns[agg.column];
+        accs[i].rows = accs[i].valid = rowGroup.num_rows();
+        if(agg.function == count)
+            continue;
+        if(agg.function != min && agg.function != max)
+            return false;
+        if(!range(column, low, high, realLow, realHigh))
+            return false;
+        if(column.lane == integer)
+            accs[i].i = (agg.function == min ? low : high) * column.scale - column.shift;
+        else
+            accs[i].f = agg.function == min ? realLow : realHigh;
+    }
+    if(!rowGroup.num_rows())
+        return true;
+    partial.index.emplace(std::string{}, 0);
+    partial.keys.emplace_back();
+    partial.accs = std::move(accs);
+    return true;
+}
+
+void AGGREGATE::scan(std::shared_ptr<parquet::RowGroupReader> rowGroup, const Plan& plan, Partial& partial){
+    std::vector<std::shared_ptr<parquet::ColumnReader>> readers;
+    for(auto& column : plan.columns)
+        readers.push_back(PREADER::column(rowGroup, column.index));
+    std::vector<Batch> batches(plan.columns.size());
+    std::vector<uint8_t> keep;
+    std::string key;
+    J rows = rowGroup->metadata()->num_rows();
+    for(J done=0;done<rows;done+=batchSize){
+        J count = std::min(batchSize, rows - done);
+        for(size_t c=0;c<plan.columns.size();c++)
+            decode(readers[c].get(), plan.columns[c], count, batches[c]);
+
+        //Filters compare the values as stored, before they're brought into q's epoch
+        keep.assign(count, 1);
+        for(auto& filter : plan.filters){
+            const Batch& batch = batches[filter.column];
+            switch(plan.columns[filter.column].lane){
+                case integer:
+                    for(J r=0;r<count;r++)
+                        keep[r] &= batch.valid[r] && (!filter.low || *filter.low <= batch.ints[r]) &&
+                                   (!filter.high || batch.ints[r] <= *filter.high);
+                    break;
+                case real:
+                    for(J r=0;r<count;r++)
+                        keep[r] &= batch.valid[r] && (!filter.realLow || *filter.realLow <= batch.reals[r]) &&
+                                   (!filter.realHigh || batch.reals[r] <= *filter.realHigh);
+                    break;
+                case text:
+                    for(J r=0;r<count;r++)
+                        keep[r] &= batch.valid[r] && (!filter.textLow || *filter.textLow <= batch.texts[r]) &&
+                                   (!filter.textHigh || batch.texts[r] <= *filter.textHigh);
+                    break;
+            }
+        }
+        for(size_t c=0;c<plan.columns.size();c++){
+            const Column& column = plan.columns[c];
+            Batch& batch = batches[c];
+            J nullValue = null(column.type);
+            for(J r=0;r<count;r++){
+                if(column.lane == integer)
+                    batch.ints[r] = batch.valid[r] && batch.ints[r] != nullValue ?
+                                    batch.ints[r] * column.scale - column.shift : nullValue;
+                else if(column.lane == real && !batch.valid[r])
+                    batch.reals[r] = std::nan("");
+                else if(column.lane == text && !batch.valid[r])
+                    batch.texts[r] = std::string_view{};
+            }
+        }
+
+        for(J r=0;r<count;r++){
+            if(!keep[r])
+                continue;
+            key.clear();
+            for(auto& by : plan.by){
+                const Batch& batch = batches[by.column];
+                switch(plan.columns[by.column].lane){
+                    case integer:{
+                        J value = batch.ints[r];
+                        if(by.width && value != null(plan.columns[by.column].type))
+                            value -= ((value % by.width) + by.width) % by.width;
+                        append(key, &value, sizeof(value));
+                        break;
+                    }
+                    case real:{
+                        double value = batch.reals[r];
+                        if(by.realWidth)
+                            value = std::floor(value / by.realWidth) * by.realWidth;
+                        append(key, &value, sizeof(value));
+                        break;
+                    }
+                    case text:{
+                        uint32_t size = batch.texts[r].size();
+                        append(key, &size, sizeof(size));
+                        append(key, batch.texts[r].data(), size);
+                        break;
+                    }
+                }
+            }
+            auto found = partial.index.find(key);
+            size_t group;
+            if(found == partial.index.end()){
+                group = partial.keys.size();
+                partial.index.emplace(key, group);
+                partial.keys.push_back(key);
+                partial.accs.resize(partial.accs.size() + plan.aggs.size());
+            } else
+                group = found->second;
+            Acc* accs = &partial.accs[group * plan.aggs.size()];
+            for(size_t a=0;a<plan.aggs.size();a++)
+                update(accs[a], plan.aggs[a].function, plan.columns[plan.aggs[a].column], batches[plan.aggs[a].column], r);
+        }
+    }
+}
+
+void AGGREGATE::decode(parquet::ColumnReader* reader, const Column& column, J rows, Batch& batch){
+    STATS_TIMER(decode);
+    //Optional columns read their values packed, they're spread over the rows by definition level.
+    //Each read may move to a new page, so consume sees the values while they're still valid
+    int16_t maxDef = reader->descr()->max_definition_level();
+    std::vector<int16_t> defs(maxDef ? rows : 0);
+    auto read = [&](auto* typed, auto* values, auto consume, auto store){
+        J levels = 0, count = 0;
+        while(levels < rows){
+            int64_t valuesRead = 0;
+            int64_t read = typed->ReadBatch(rows - levels, maxDef ? defs.data() + levels : nullptr, nullptr,
+                                            values + count, &valuesRead);
+            if(!read)
+                throw std::runtime_error("Column " + column.name + " ended before the row group");
+            consume(values + count, valuesRead);
+            levels += read;
+            count += valuesRead;
+        }
+        batch.valid.resize(rows);
+        for(J r=0, v=0;r<rows;r++){
+            batch.valid[r] = !maxDef || defs[r] == maxDef;
+            if(batch.valid[r])
+                store(r, v++);
+        }
+    };
+    auto none = [](auto*, J){};
+    switch(reader->type()){
+        case Type::BOOLEAN:{
+            std::unique_ptr<bool[]> values(new bool[rows]);
+            batch.ints.resize(rows);
+            read(static_cast<parquet::BoolReader*>(reader), values.get(), none,
+                 [&](J r, J v){ batch.ints[r] = values[v]; });
+            break;
+        }
+        case Type::INT32:{
+            std::vector<int32_t> values(rows);
+            batch.ints.resize(rows);
+            read(static_cast<parquet::Int32Reader*>(reader), values.data(), none,
+                 [&](J r, J v){ batch.ints[r] = values[v]; });
+            break;
+        }
+        case Type::INT64:{
+            std::vector<int64_t> values(rows);
+            batch.ints.resize(rows);
+            read(static_cast<parquet::Int64Reader*>(reader), values.data(), none,
+                 [&](J r, J v){ batch.ints[r] = values[v]; });
+            break;
+        }
+        case Type::FLOAT:{
+            std::vector<float> values(rows);
+            batch.reals.resize(rows);
+            read(static_cast<parquet::FloatReader*>(reader), values.data(), none,
+                 [&](J r, J v){ batch.reals[r] = values[v]; });
+            break;
+        }
+        case Type::DOUBLE:{
+            std::vector<double> values(rows);
+            batch.reals.resize(rows);
+            read(static_cast<parquet::DoubleReader*>(reader), values.data(), none,
+                 [&](J r, J v){ batch.reals[r] = values[v]; });
+            break;
+        }
+        case Type::BYTE_ARRAY:{
+            //Copied out of the page as it's read, views are taken once the batch stops growing
+            std::vector<parquet::ByteArray> values(rows);
+            std::vector<std::pair<size_t, size_t>> spans;
+            batch.arena.clear();
+            batch.texts.resize(rows);
+            read(static_cast<parquet::ByteArrayReader*>(reader), values.data(),
+                 [&](parquet::ByteArray* read, J count){
+                     for(J i=0;i<count;i++){
+                         spans.emplace_back(batch.arena.size(), read[i].len);
+                         batch.arena.append(reinterpret_cast<const char*>(read[i].ptr), read[i].len);
+                     }
+                 },
+                 [&](J r, J v){ batch.texts[r] = std::string_view(batch.arena).substr(spans[v].first, spans[v].second); });
+            break;
+        }
+        default:
+            throw std::runtime_error("Can't aggregate the column " + column.name);
+    }
+}
+
+void AGGREGATE::update(Acc& acc, Function function, const Column& column, const Batch& batch, J row){
+    acc.rows++;
+    if(function == count)
+        return;
+    switch(column.lane){
+        case integer:{
+            J value = batch.ints[row];
+            if(function == first || function == last){
+                if(function == last || acc.rows == 1)
+                    acc.i = value;
+                return;
+            }
+            if(value == null(column.type))
+                return;
+            if(function == sum)
+                acc.i += value;
+            else if(function == avg)
+                acc.f += value;
+            else if(!acc.valid || (function == min ? value < acc.i : value > acc.i))
+                acc.i = value;
+            acc.valid++;
+            return;
+        }
+        case real:{
+            double value = batch.reals[row];
+            if(function == first || function == last){
+                if(function == last || acc.rows == 1)
+                    acc.f = value;
+                return;
+            }
+            if(std::isnan(value))
+                return;
+            if(function == sum || function == avg)
+                acc.f += value;
+            else if(!acc.valid || (function == min ? value < acc.f : value > acc.f))
+                acc.f = value;
+            acc.valid++;
+            return;
+        }
+        case text:
+            if(function == last || acc.rows == 1)
+                acc.s = batch.texts[row];
+            return;
+    }
+}
+
+void AGGREGATE::combine(Acc& acc, const Acc& from, Function function, Lane lane){
+    switch(function){
+        case first:
+        case last:
+            if(function == first ? !acc.rows : from.rows != 0){
+                acc.i = from.i;
+                acc.f = from.f;
+                acc.s = from.s;
+            }
+            break;
+        case sum:
+        case avg:
+            acc.i += from.i;
+            acc.f += from.f;
+            break;
+        case min:
+        case max:{
+            bool less = lane == integer ? from.i < acc.i : from.f < acc.f;
+            bool greater = lane == integer ? from.i > acc.i : from.f > acc.f;
+            if(from.valid && (!acc.valid || (function == min ? less : greater))){
+                acc.i = from.i;
+                acc.f = from.f;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    acc.rows += from.rows;
+    acc.valid += from.valid;
+}
+
+void AGGREGATE::merge(Partial& into, const Partial& from, const Plan& plan){
+    size_t aggs = plan.aggs.size();
+    for(size_t g=0;g<from.keys.size();g++){
+        auto found = into.index.find(from.keys[g]);
+        size_t group;
+        if(found == into.index.end()){
+            group = into.keys.size();
+            into.index.emplace(from.keys[g], group);
+            into.keys.push_back(from.keys[g]);
+            into.accs.resize(into.accs.size() + aggs);
+        } else
+            group = found->second;
+        for(size_t a=0;a<aggs;a++)
+            combine(into.accs[group * aggs + a], from.accs[g * aggs + a], plan.aggs[a].function,
+                    plan.columns[plan.aggs[a].column].lane);
+    }
+}
+
+K AGGREGATE::result(const Plan& plan, const Partial& partial, K by, K aggs){
+    //Without grouping there's always a row, as for a q select without by
+    size_t groups = plan.by.empty() ? 1 : partial.keys.size();
+    std::vector<Acc> empty(plan.aggs.size());
+    const Acc* accs = partial.keys.empty() ? empty.data() : partial.accs.data();
+
+    //Keys are unpacked into a column per by, in the order they were packed
+    std::vector<std::vector<J>> ints(plan.by.size(), std::vector<J>(groups));
+    std::vector<std::vector<double>> reals(plan.by.size(), std::vector<double>(groups));
+    std::vector<std::vector<std::string>> texts(plan.by.size(), std::vector<std::string>(groups));
+    for(size_t g=0;g<partial.keys.size() && !plan.by.empty();g++){
+        const char* key = partial.keys[g].data();
+        for(size_t b=0;b<plan.by.size();b++){
+            switch(plan.columns[plan.by[b].column].lane){
+                case integer:
+                    std::memcpy(&ints[b][g], key, sizeof(J));
+                    key += sizeof(J);
+                    break;
+                case real:
+                    std::memcpy(&reals[b][g], key, sizeof(double));
+                    key += sizeof(double);
+                    break;
+                case text:{
+                    uint32_t size;
+                    std::memcpy(&size, key, sizeof(size));
+                    texts[b][g].assign(key + sizeof(size), size);
+                    key += sizeof(size) + size;
+                    break;
+                }
+            }
+        }
+    }
+
+    //Groups come back sorted by their keys, as q's by does
+    std::vector<size_t> order(groups);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t x, size_t y){
+        for(size_t b=0;b<plan.by.size();b++){
+            int res;
+            switch(plan.columns[plan.by[b].column].lane){
+                case integer:
+                    res = (ints[b][x] > ints[b][y]) - (ints[b][x] < ints[b][y]);
+                    break;
+                case real:
+                    res = compare(reals[b][x], reals[b][y]);
+                    break;
+                default:
+                    res = texts[b][x].compare(texts[b][y]);
+                    break;
+            }
+            if(res)
+                return res < 0;
+        }
+        return false;
+    });
+
+    K keyCols = ktn(0, 0);
+    for(size_t b=0;b<plan.by.size();b++){
+        const Column& column = plan.columns[plan.by[b].column];
+        K col = ktn(column.type, groups);
+        for(size_t g=0;g<groups;g++){
+            if(column.lane == text)
+                kS(col)[g] = ss(const_cast<S>(texts[b][order[g]].c_str()));
+            else
+                set(col, g, ints[b][order[g]], reals[b][order[g]]);
+        }
+        jk(&keyCols, col);
+    }
+
+    K valueCols = ktn(0, 0);
+    size_t n = plan.aggs.size();
+    for(size_t a=0;a<n;a++){
+        const Column& column = plan.columns[plan.aggs[a].column];
+        Function function = plan.aggs[a].function;
+        int type = function == count ? KJ : function == avg ? KF :
+                   function == sum ? (column.lane == integer ? KJ : KF) : column.type;
+        K col = ktn(type, groups);
+        for(size_t g=0;g<groups;g++){
+            const Acc& acc = accs[order[g] * n + a];
+            bool missing = (function == min || function == max) ? !acc.valid : !acc.rows;
+            switch(function){
+                case count:
+                    kJ(col)[g] = acc.rows;
+                    break;
+                case avg:
+                    kF(col)[g] = acc.valid ? acc.f / acc.valid : nf;
+                    break;
+                case sum:
+                    set(col, g, acc.i, acc.f);
+                    break;
+                default:
+                    if(column.lane == text)
+                        kS(col)[g] = ss(const_cast<S>(missing ? "" : acc.s.c_str()));
+                    else
+                        set(col, g, missing ? null(type) : acc.i, missing ? nf : acc.f);
+                    break;
+            }
+        }
+        jk(&valueCols, col);
+    }
+
+    K values = xT(xD(r1(kK(aggs)[0]), valueCols));
+    if(plan.by.empty()){
+        r0(keyCols);
+        return values;
+    }
+    return xD(xT(xD(r1(kK(by)[0]), keyCols)), values);
+}
+
+J AGGREGATE::null(int type){
+    switch(type){
+        case KH:
+            return nh;
+        case KI: case KD: case KT: case KM: case KU: case KV:
+            return ni;
+        default:
+            //Booleans and bytes have no null, nj is never one of their values
+            return nj;
+    }
+}
+
+void AGGREGATE::set(K vector, J index, J value, double real){
+    switch(vector->t){
+        case KB: case KG:
+            kG(vector)[index] = value;
+            break;
+        case KH:
+            kH(vector)[index] = value;
+            break;
+        case KI: case KD: case KT: case KM: case KU: case KV:
+            kI(vector)[index] = value;
+            break;
+        case KE:
+            kE(vector)[index] = real;
+            break;
+        case KF: case KZ:
+            kF(vector)[index] = real;
+            break;
+        default:
+            kJ(vector)[index] = value;
+            break;
+    }
+}
@@ -0,0 +1,235 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <append.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <numeric>
+#include <unistd.h>
+
+using namespace KDB::PARQ;
+
+namespace{
+    void check(bool ok, const std::string& what, const std::string& fileName){
+        if(!ok)
+            throw std::runtime_error(what + " " + fileName + " failed: " + std::strerror(errno));
+    }
+
+    //A whole buffer at an offset, pread and pwrite can return short
+    void readAt(int fd, char* data, int64_t length, int64_t offset, const std::string& fileName){
+        for(int64_t done=0;done<length;){
+            ssize_t res = pread(fd, data + done, length - done, offset + done);
+            if(res < 0 && errno == EINTR)
+                continue;
+            check(res > 0, "Reading", fileName);
+            done += res;
+        }
+    }
+
+    void writeAt(int fd, const char* data, int64_t length, int64_t offset, const std::string& fileName){
+        for(int64_t done=0;done<length;){
+            ssize_t res = pwrite(fd, data + done, length - done, offset + done);
+            if(res < 0 && errno == EINTR)
+                continue;
+            check(res >= 0, "Writing", fileName);
+            done += res;
+        }
+    }
+}
+
+APPEND::Stream::Stream(std::shared_ptr<arrow::io::OutputStream> sink, int64_t start)
+        : sink(sink), position(start), skip(4)
+{
+}
+
+arrow::Status APPEND::Stream::Close(){
+    return sink->Close();
+}
+
+bool APPEND::Stream::closed() const{
+    return sink->closed();
+}
+
+arrow::Result<int64_t> APPEND::Stream::Tell() const{
+    //Writers refuse to open on a stream that isn't at its start
+    return skip == 4 ? 0 : position;
+}
+
+arrow::Status APPEND::Stream::Write(const void* data, int64_t nbytes){
+    int64_t dropped = std::min(skip, nbytes);
+    skip -= dropped;
+    position += nbytes;
+    return sink->Write(static_cast<const uint8_t*>(data) + dropped, nbytes - dropped);
+}
+
+arrow::Status APPEND::Stream::Flush(){
+    return sink->Flush();
+}
+
+std::shared_ptr<parquet::ParquetFileWriter> APPEND::open(const std::string& fileName,
+                                                         std::shared_ptr<GroupNode> schema,
+                                                         parquet::Compression::type codec,
+                                                         K metadata,
+                                                         K props,
+                                                         State& state){
+    //An append that didn't finish is undone before starting another
+    recover(fileName);
+    state.fileName = fileName;
+    if(!std::filesystem::exists(fileName) || !std::filesystem::file_size(fileName))
+        return WRITER::OpenFile(fileName, schema, codec, false, metadata, props, WRITER::ColumnOptions(props),
+                                state.sink);
+
+    int64_t size;
+    state.footer = footer(fileName, size);
+    std::shared_ptr<arrow::io::ReadableFile> file;
+    PARQUET_ASSIGN_OR_THROW(file, arrow::io::ReadableFile::Open(fileName, &POOL::getInstance()));
+    state.metadata = parquet::ReadMetaData(file);
+    PARQUET_THROW_NOT_OK(file->Close());
+    parquet::SchemaDescriptor descriptor;
+    descriptor.Init(schema);
+    if(!state.metadata->schema()->Equals(descriptor))
+        throw std::runtime_error("Table doesn't match the schema of " + fileName +
+                                 ", the columns, their types and the nullable option must be the same");
+
+    //The journal holds the old footer, written whole and synced before the file is touched
+    std::vector<char> tail(sizeof(int64_t) + size - state.footer);
+    std::memcpy(tail.data(), &state.footer, sizeof(int64_t));
+    int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    check(fd >= 0, "Opening", fileName);
+    try{
+        readAt(fd, tail.data() + sizeof(int64_t), size - state.footer, state.footer, fileName);
+    }catch(...){
+        close(fd);
+        throw;
+    }
+    close(fd);
+    std::string temp = journal(fileName) + ".tmp";
+    fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    check(fd >= 0, "Opening", temp);
+    try{
+        writeAt(fd, tail.data(), tail.size(), 0, temp);
+        check(fsync(fd) == 0, "Syncing", temp);
+    }catch(...){
+        close(fd);
+        throw;
+    }
+    close(fd);
+    std::filesystem::rename(temp, journal(fileName));
+
+    check(truncate(fileName.c_str(), state.footer) == 0, "Truncating", fileName);
+    state.sink = std::make_shared<Stream>(WRITER::OpenStream(fileName, true, props), state.footer - 4);
+    //Key value metadata stays as it was in the old footer
+    return parquet::ParquetFileWriter::Open(state.sink, schema,
+                                            WRITER::WriterProperties(codec, props, WRITER::ColumnOptions(props), schema));
+}
+
+std::shared_ptr<parquet::FileMetaData> APPEND::finish(const State& state,
+                                                      std::shared_ptr<parquet::ParquetFileWriter> writer){
+    WRITER::CloseFile(writer, state.sink);
+    if(!state.metadata)
+        return writer->metadata();
+
+    //The writer's own footer only has the new row groups, it's replaced by the merged one
+    std::vector<int> rowGroups(state.metadata->num_row_groups());
+    std::iota(rowGroups.begin(), rowGroups.end(), 0);
+    std::shared_ptr<parquet::FileMetaData> merged = state.metadata->Subset(rowGroups);
+    merged->AppendRowGroups(*writer->metadata());
+    int64_t size;
+    check(truncate(state.fileName.c_str(), footer(state.fileName, size)) == 0, "Truncating", state.fileName);
+    std::shared_ptr<arrow::io::FileOutputStream> out;
+    PARQUET_ASSIGN_OR_THROW(out, arrow::io::FileOutputStream::Open(state.fileName, true));
+    parquet::WriteFileMetaData(*merged, out.get());
+    PARQUET_THROW_NOT_OK(out->Close());
+
+    //Synced before the journal goes, a crash until then undoes the whole append
+    sync(state.fileName);
+    std::filesystem::remove(journal(state.fileName));
+    return merged;
+}
+
+bool APPEND::recover(const std::string& fileName){
+    std::string path = journal(fileName);
+    std::filesystem::remove(path + ".tmp");
+    if(!std::filesystem::exists(path))
+        return false;
+    int64_t length = std::filesystem::file_size(path);
+    if(length < static_cast<int64_t>(sizeof(int64_t)))
+        throw std::runtime_error("Journal " + path + " is incomplete");
+    std::vector<char> tail(length);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    check(fd >= 0, "Opening", path);
+    try{
+        readAt(fd, tail.data(), length, 0, path);
+    }catch(...){
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    //Put back the old footer where it was, leaving the file as it was before the append
+    int64_t offset;
+    std::memcpy(&offset, tail.data(), sizeof(int64_t));
+    fd = ::open(fileName.c_str(), O_WRONLY | O_CLOEXEC);
+    check(fd >= 0, "Opening", fileName);
+    try{
+        check(ftruncate(fd, offset) == 0, "Truncating", fileName);
+        writeAt(fd, tail.data() + sizeof(int64_t), length - sizeof(int64_t), offset, fileName);
+        check(fsync(fd) == 0, "Syncing", fileName);
+    }catch(...){
+        close(fd);
+        throw;
+    }
+    close(fd);
+    std::filesystem::remove(path);
+    return true;
+}
+
+std::string APPEND::journal(const std::string& fileName){
+    return fileName + ".journal";
+}
+
+int64_t APPEND::footer(const std::string& fileName, int64_t& size){
+    //Files end with the footer, its length and PAR1
+    size = std::filesystem::file_size(fileName);
+    char end[8];
+    if(size < 12)
+        throw std::runtime_error("Not a parquet file: " + fileName);
+    int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    check(fd >= 0, "Opening", fileName);
+    try{
+        readAt(fd, end, sizeof(end), size - sizeof(end), fileName);
+    }catch(...){
+        close(fd);
+        throw;
+    }
+    close(fd);
+    uint32_t length;
+    std::memcpy(&length, end, sizeof(length));
+    if(std::memcmp(end + 4, "PAR1", 4) || length > size - 12)
+        throw std::runtime_error("Not a parquet file: " + fileName);
+    return size - sizeof(end) - length;
+}
+
+void APPEND::sync(const std::string& fileName){
+    int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    check(fd >= 0, "Opening", fileName);
+    int res = fsync(fd);
+    close(fd);
+    check(res == 0, "Syncing", fileName);
+}
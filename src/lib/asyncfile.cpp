@@ -0,0 +1,203 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <asyncfile.hpp>
+#include <stats.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace KDB::PARQ;
+
+namespace{
+    arrow::Status ioError(const char* what){
+        return arrow::Status::IOError(what, " failed. Detail: ", std::strerror(errno));
+    }
+}
+
+arrow::Result<std::shared_ptr<arrow::io::OutputStream>> ASYNCFILE::Open(const std::string& path, bool append,
+                                                                        int64_t bufferSize, int64_t preallocate,
+                                                                        bool sync, arrow::MemoryPool* pool){
+    //Buffers are page aligned so the kernel can take whole pages
+    bufferSize = std::max<int64_t>(bufferSize, 4096) / 4096 * 4096;
+    std::vector<std::unique_ptr<arrow::Buffer>> blocks;
+    for(int i=0;i<buffers;i++){
+        ARROW_ASSIGN_OR_RAISE(std::unique_ptr<arrow::Buffer> buffer, arrow::AllocateBuffer(bufferSize, 4096, pool));
+        blocks.push_back(std::move(buffer));
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC), 0666);
+    if(fd < 0)
+        return arrow::Status::IOError("Failed to open local file '", path, "'. Detail: ", std::strerror(errno));
+    struct stat st;
+    if(fstat(fd, &st) < 0){
+        arrow::Status status = ioError("fstat");
+        close(fd);
+        return status;
+    }
+    return std::shared_ptr<arrow::io::OutputStream>(
+        new ASYNCFILE(fd, append ? st.st_size : 0, std::max<int64_t>(preallocate, 0), sync, std::move(blocks)));
+}
+
+ASYNCFILE::ASYNCFILE(int fd, int64_t offset, int64_t preallocate, bool sync,
+                     std::vector<std::unique_ptr<arrow::Buffer>> pool)
+        : fd(fd), position(offset), offset(offset), preallocate(preallocate), reserved(offset), sync(sync),
+          owned(std::move(pool)), current(nullptr), fill(0), writing(false), stopping(false)
+{
+    current = owned[0].get();
+    for(size_t i=1;i<owned.size();i++)
+        free.push_back(owned[i].get());
+    thread = std::thread(&ASYNCFILE::run, this);
+}
+
+ASYNCFILE::~ASYNCFILE(){
+    //Errors can only be reported by an explicit Close
+    if(!closed())
+        static_cast<void>(Close());
+}
+
+arrow::Status ASYNCFILE::Close(){
+    if(closed())
+        return arrow::Status::OK();
+    arrow::Status status = drain();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+    //Truncating to the written size hands back whatever was reserved past it
+    if(reserved > offset && ftruncate(fd, offset) < 0 && status.ok())
+        status = ioError("ftruncate");
+    if(status.ok() && sync && fsync(fd) < 0)
+        status = ioError("fsync");
+    if(close(fd) < 0 && status.ok())
+        status = ioError("close");
+    fd = -1;
+    return status;
+}
+
+bool ASYNCFILE::closed() const{
+    return fd < 0;
+}
+
+arrow::Result<int64_t> ASYNCFILE::Tell() const{
+    if(closed())
+        return arrow::Status::Invalid("Operation on closed file");
+    return position;
+}
+
+arrow::Status ASYNCFILE::Write(const void* data, int64_t nbytes){
+    if(closed())
+        return arrow::Status::Invalid("Operation on closed file");
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while(nbytes > 0){
+        int64_t count = std::min(nbytes, current->size() - fill);
+        std::memcpy(current->mutable_data() + fill, bytes, count);
+        fill += count;
+        bytes += count;
+        nbytes -= count;
+        position += count;
+        if(fill == current->size())
+            ARROW_RETURN_NOT_OK(submit());
+    }
+    return arrow::Status::OK();
+}
+
+arrow::Status ASYNCFILE::Flush(){
+    if(closed())
+        return arrow::Status::Invalid("Operation on closed file");
+    return drain();
+}
+
+arrow::Status ASYNCFILE::submit(){
+    if(!fill)
+        return arrow::Status::OK();
+    std::unique_lock<std::mutex> lock(mutex);
+    //Backpressure, encoding waits when the IO thread is a whole buffer behind
+    cv.wait(lock, [this]{ return !free.empty() || !error.ok(); });
+    if(!error.ok())
+        return error;
+    queue.push_back({current, fill, offset});
+    offset += fill;
+    current = free.back();
+    free.pop_back();
+    fill = 0;
+    cv.notify_all();
+    return arrow::Status::OK();
+}
+
+arrow::Status ASYNCFILE::drain(){
+    ARROW_RETURN_NOT_OK(submit());
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]{ return (queue.empty() && !writing) || !error.ok(); });
+    return error;
+}
+
+void ASYNCFILE::run(){
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+        cv.wait(lock, [this]{ return !queue.empty() || stopping; });
+        if(queue.empty())
+            return;
+        Block block = queue.front();
+        queue.pop_front();
+        writing = true;
+        lock.unlock();
+
+        arrow::Status status = reserve(block.offset + block.length);
+        int64_t done = 0;
+        {
+            STATS_TIMER(io);
+            while(status.ok() && done < block.length){
+                ssize_t res = pwrite(fd, block.buffer->data() + done, block.length - done, block.offset + done);
+                if(res < 0 && errno == EINTR)
+                    continue;
+                if(res < 0)
+                    status = ioError("pwrite");
+                else
+                    done += res;
+            }
+        }
+        STATS_ADD(bytes, done);
+
+        lock.lock();
+        writing = false;
+        if(!status.ok() && error.ok())
+            error = status;
+        free.push_back(block.buffer);
+        cv.notify_all();
+    }
+}
+
+arrow::Status ASYNCFILE::reserve(int64_t end){
+    //Extents are allocated ahead of the writes in preallocate sized steps, keeping the
+    //file size as written so a partly written file doesn't look complete
+    if(!preallocate || end <= reserved)
+        return arrow::Status::OK();
+    int64_t length = std::max(preallocate, end - reserved);
+    if(fallocate(fd, FALLOC_FL_KEEP_SIZE, reserved, length) < 0){
+        //Filesystems without fallocate just skip it
+        if(errno == EOPNOTSUPP || errno == ENOSYS){
+            preallocate = 0;
+            return arrow::Status::OK();
+        }
+        return ioError("fallocate");
+    }
+    reserved += length;
+    return arrow::Status::OK();
+}
@@ -0,0 +1,117 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <parquet.hpp>
+#include <arrow/buffer.h>
+#include <arrow/io/memory.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace KDB::PARQ;
+
+std::shared_ptr<parquet::ParquetFileReader> BYTES::open(K bytes){
+    //The buffer doesn't own the vector, it is only read while q holds it for the call. Column chunks
+    //come back as slices of it, so nothing is copied before decoding
+    auto buffer = std::make_shared<arrow::Buffer>(kG(bytes), bytes->n);
+    return parquet::ParquetFileReader::Open(STATS::file(std::make_shared<arrow::io::BufferReader>(buffer)),
+                                            parquet::ReaderProperties(&POOL::getInstance()));
+}
+
+K BYTES::read(K bytes, J group, K cols){
+    STATS_SPAN("readBytes");
+    std::shared_ptr<parquet::ParquetFileReader> reader = open(bytes);
+    std::shared_ptr<parquet::FileMetaData> metadata = reader->metadata();
+    std::shared_ptr<const PREADER::Plan> plan = PREADER::plan(metadata->schema());
+    int groups = metadata->num_row_groups();
+    if(group != nj && (group < 0 || group >= groups))
+        throw std::runtime_error("Row group out of range");
+    std::vector<int> reads;
+    for(int i=0;i<groups;i++)
+        if(group == nj || group == i)
+            reads.push_back(i);
+    auto readTable = [&](int i){
+        std::shared_ptr<parquet::RowGroupReader> row_group_reader = reader->RowGroup(i);
+        return PKDB::readTable(row_group_reader,
+                               cols->n ? cols->n : row_group_reader->metadata()->num_columns(),
+                               row_group_reader->metadata()->num_rows(),
+                               cols,
+                               *plan);
+    };
+    //A single row group is returned as it was read
+    if(reads.size() == 1)
+        return readTable(reads[0]);
+
+    std::vector<int> indices = PREADER::columnIndices(reader, cols);
+    K names = ktn(KS, indices.size());
+    K values = ktn(0, indices.size());
+    for(size_t c=0;c<indices.size();c++){
+        const parquet::ColumnDescriptor* descr = metadata->schema()->Column(indices[c]);
+        kS(names)[c] = ss(const_cast<S>(PREADER::columnName(descr).c_str()));
+        //List columns are read as general lists of their item type
+        kK(values)[c] = ktn(descr->max_repetition_level() > 0 ? 0 : (*plan)[indices[c]].kType, 0);
+    }
+    try{
+        for(int i : reads){
+            K table = readTable(i);
+            if(!table){
+                r0(names);
+                r0(values);
+                return table;
+            }
+            K columns = kK(table->k)[1];
+            for(J c=0;c<columns->n;c++)
+                jv(&kK(values)[c], kK(columns)[c]);
+            r0(table);
+        }
+    }catch(...){
+        r0(names);
+        r0(values);
+        throw;
+    }
+    return xT(xD(names, values));
+}
+
+K BYTES::write(K tables, parquet::Compression::type codec, K metadata, K props){
+    STATS_SPAN("writeBytes");
+    K colNames = kK(kK(tables)[0]->k)[0];
+    K colValues = kK(kK(tables)[0]->k)[1];
+    std::shared_ptr<GroupNode> schema = WRITER::SetupSchema(colNames, colValues, colValues->n,
+                                                            dictBool(props, "nullable", false));
+    std::shared_ptr<arrow::io::BufferOutputStream> sink;
+    PARQUET_ASSIGN_OR_THROW(sink, arrow::io::BufferOutputStream::Create(initialCapacity, &POOL::getInstance()));
+    std::shared_ptr<parquet::ParquetFileWriter> file_writer =
+        parquet::ParquetFileWriter::Open(sink, schema,
+                                         WRITER::WriterProperties(codec, props, WRITER::ColumnOptions(props), schema),
+                                         metadata->n ? WRITER::KeyValueMetadata(metadata) : NULLPTR);
+
+    //Each table is a row group
+    for(J t=0;t<tables->n;t++){
+        K names = kK(kK(tables)[t]->k)[0];
+        K values = kK(kK(tables)[t]->k)[1];
+        if(names->n != colNames->n || !std::equal(kS(names), kS(names) + names->n, kS(colNames)))
+            throw std::runtime_error("Row groups must all have the same columns");
+        parquet::RowGroupWriter* rg_writer = file_writer->AppendRowGroup();
+        for(J i=0;i<values->n;i++)
+            WRITER::writeColumn(kK(values)[i], rg_writer);
+    }
+    file_writer->Close();
+
+    std::shared_ptr<arrow::Buffer> image;
+    PARQUET_ASSIGN_OR_THROW(image, sink->Finish());
+    K bytes = ktn(KG, image->size());
+    std::memcpy(kG(bytes), image->data(), image->size());
+    return bytes;
+}
@@ -0,0 +1,416 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <compact.hpp>
+#include <stats.hpp>
+#include <arrow/util/config.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace KDB::PARQ;
+
+namespace{
+    //Row groups are moved in slices of this size rather than whole chunks
+    constexpr int64_t copyBlock = 1 << 22;
+
+    bool isDictionary(parquet::Encoding::type encoding){
+        return encoding == parquet::Encoding::RLE_DICTIONARY || encoding == parquet::Encoding::PLAIN_DICTIONARY;
+    }
+}
+
+COMPACT::Segment::Segment(std::shared_ptr<arrow::io::OutputStream> sink, int64_t start)
+        : sink(sink), position(start), skip(4), discarding(false), isClosed(false)
+{
+}
+
+arrow::Status COMPACT::Segment::Close(){
+    //The output carries on after the segment, it's closed by its owner
+    isClosed = true;
+    return arrow::Status::OK();
+}
+
+bool COMPACT::Segment::closed() const{
+    return isClosed;
+}
+
+arrow::Result<int64_t> COMPACT::Segment::Tell() const{
+    //Writers refuse to open on a stream that isn't at its start
+    return skip == 4 ? 0 : position;
+}
+
+arrow::Status COMPACT::Segment::Write(const void* data, int64_t nbytes){
+    int64_t dropped = discarding ? nbytes : std::min(skip, nbytes);
+    skip -= std::min(skip, nbytes);
+    position += nbytes;
+    return sink->Write(static_cast<const uint8_t*>(data) + dropped, nbytes - dropped);
+}
+
+arrow::Status COMPACT::Segment::Flush(){
+    return sink->Flush();
+}
+
+void COMPACT::Segment::discard(){
+    discarding = true;
+}
+
+K COMPACT::run(K inputs, K outputs, J target, parquet::Compression::type codec, K props){
+    if(target <= 0)
+        throw std::runtime_error("Row group size must be positive");
+    //One output and its files, or a list of outputs and a list of files for each
+    bool single = outputs->t == -KS || outputs->t == KC;
+    std::vector<std::string> outputNames = single ? std::vector<std::string> {k2string(outputs)} : k2StrVec(outputs);
+    std::vector<std::vector<std::string>> inputNames;
+    if(single)
+        inputNames.push_back(k2StrVec(inputs));
+    else{
+        if(inputs->t != 0 || inputs->n != outputs->n)
+            throw std::runtime_error("Inputs must be a list of files for each output");
+        for(J i=0;i<inputs->n;i++){
+            K files = kK(inputs)[i];
+            if(files->t != KS && files->t != 0)
+                throw std::runtime_error("Inputs must be a list of files for each output");
+            inputNames.push_back(k2StrVec(files));
+        }
+    }
+
+    std::vector<WRITER::ColumnOption> columns = WRITER::ColumnOptions(props);
+    std::vector<Result> results(outputNames.size());
+    std::atomic<size_t> next {0};
+    std::mutex mutex;
+    std::string error;
+    auto work = [&](){
+        THREADS::Busy busy;
+        for(size_t i=next++;i<outputNames.size();i=next++){
+            try{
+                results[i] = file(inputNames[i], outputNames[i], target, codec, props, columns);
+            }catch(const std::exception& e){
+                std::lock_guard<std::mutex> lock(mutex);
+                if(error.empty())
+                    error = e.what();
+                next = outputNames.size();
+            }
+        }
+    };
+    J threads = std::min<J>(THREADS::workers(), outputNames.size());
+    if(threads <= 1)
+        work();
+    else{
+        std::vector<std::thread> workers;
+        for(J i=0;i<threads;i++)
+            workers.emplace_back([&](){
+                THREADS::pin();
+                work();
+            });
+        for(auto& worker : workers)
+            worker.join();
+    }
+    if(!error.empty())
+        throw std::runtime_error(error);
+
+    K files = ktn(KS, outputNames.size());
+    K rowGroups = ktn(KJ, outputNames.size());
+    K rows = ktn(KJ, outputNames.size());
+    K copied = ktn(KJ, outputNames.size());
+    for(size_t i=0;i<outputNames.size();i++){
+        kS(files)[i] = ss(const_cast<S>(outputNames[i].c_str()));
+        kJ(rowGroups)[i] = results[i].rowGroups;
+        kJ(rows)[i] = results[i].rows;
+        kJ(copied)[i] = results[i].copied;
+    }
+    K names = ktn(KS, 4);
+    kS(names)[0] = ss(const_cast<S>("file"));
+    kS(names)[1] = ss(const_cast<S>("rowGroups"));
+    kS(names)[2] = ss(const_cast<S>("rows"));
+    kS(names)[3] = ss(const_cast<S>("copied"));
+    return xT(xD(names, knk(4, files, rowGroups, rows, copied)));
+}
+
+COMPACT::Result COMPACT::file(const std::vector<std::string>& inputs, const std::string& output,
+                              J target, parquet::Compression::type codec, K props,
+                              const std::vector<WRITER::ColumnOption>& columns){
+    STATS_SPAN("compact");
+    if(inputs.empty())
+        throw std::runtime_error("No files to compact into " + output);
+    std::vector<Input> files;
+    for(auto& fileName : inputs){
+        Input input;
+        input.fileName = fileName;
+        std::shared_ptr<arrow::io::ReadableFile> file;
+        PARQUET_ASSIGN_OR_THROW(file, arrow::io::ReadableFile::Open(fileName, &POOL::getInstance()));
+        input.file = STATS::file(file);
+        input.reader = parquet::ParquetFileReader::Open(input.file, parquet::ReaderProperties(&POOL::getInstance()));
+        if(!files.empty() && !input.reader->metadata()->schema()->Equals(*files[0].reader->metadata()->schema()))
+            throw std::runtime_error("Schema of " + fileName + " doesn't match " + files[0].fileName);
+        files.push_back(input);
+    }
+    const parquet::SchemaDescriptor* schema = files[0].reader->metadata()->schema();
+    std::shared_ptr<parquet::WriterProperties> writerProps =
+        WRITER::WriterProperties(codec, props, columns, std::static_pointer_cast<GroupNode>(schema->schema_root()));
+    std::vector<Group> groups = plan(files, target, *writerProps);
+
+    //Written beside the output and renamed over it, so an input can also be the output
+    Result result;
+    std::string temp = output + ".tmp";
+    std::shared_ptr<arrow::io::OutputStream> sink;
+    try{
+        sink = WRITER::OpenStream(temp, false, props);
+        PARQUET_THROW_NOT_OK(sink->Write("PAR1", 4));
+        std::unique_ptr<parquet::FileMetaDataBuilder> builder = parquet::FileMetaDataBuilder::Make(schema, writerProps);
+        for(auto& group : groups){
+            if(group.copy)
+                copy(group, files, sink, *builder);
+            else
+                encode(group, files, sink, writerProps, *builder);
+            result.rowGroups++;
+            result.copied += group.copy;
+        }
+        std::unique_ptr<parquet::FileMetaData> metadata = builder->Finish(keyValueMetadata(files));
+        result.rows = metadata->num_rows();
+        parquet::WriteFileMetaData(*metadata, sink.get());
+        PARQUET_THROW_NOT_OK(sink->Close());
+    }catch(...){
+        if(sink)
+            (void)sink->Close();
+        std::filesystem::remove(temp);
+        throw;
+    }
+    std::filesystem::rename(temp, output);
+    return result;
+}
+
+std::vector<COMPACT::Group> COMPACT::plan(const std::vector<Input>& inputs, J target,
+                                          const parquet::WriterProperties& writerProps){
+    std::vector<Group> groups;
+    Group pending {{}, false};
+    J pendingRows = 0;
+    auto flush = [&](){
+        if(pending.sources.empty())
+            return;
+        //A row group left on its own needs no regrouping, only its encoding can stop a copy
+        if(pending.sources.size() == 1){
+            const Source& source = pending.sources[0];
+            pending.copy = copyable(*inputs[source.input].reader->metadata()->RowGroup(source.rowGroup), writerProps);
+        }
+        groups.push_back(pending);
+        pending = Group {{}, false};
+        pendingRows = 0;
+    };
+    for(size_t i=0;i<inputs.size();i++){
+        std::shared_ptr<parquet::FileMetaData> metadata = inputs[i].reader->metadata();
+        for(int j=0;j<metadata->num_row_groups();j++){
+            J rows = metadata->RowGroup(j)->num_rows();
+            if(!rows)
+                continue;
+            //At least half the target is big enough to keep as it is
+            if(rows * 2 >= target){
+                flush();
+                pending.sources.push_back({static_cast<int>(i), j});
+                flush();
+                continue;
+            }
+            if(pendingRows + rows > target)
+                flush();
+            pending.sources.push_back({static_cast<int>(i), j});
+            pendingRows += rows;
+        }
+    }
+    flush();
+    return groups;
+}
+
+bool COMPACT::copyable(const parquet::RowGroupMetaData& rowGroup, const parquet::WriterProperties& writerProps){
+    bool pageV2 = writerProps.data_page_version() == parquet::ParquetDataPageVersion::V2;
+    for(int i=0;i<rowGroup.num_columns();i++){
+        std::unique_ptr<parquet::ColumnChunkMetaData> chunk = rowGroup.ColumnChunk(i);
+        const parquet::ColumnDescriptor* descr = rowGroup.schema()->Column(i);
+        std::shared_ptr<parquet::schema::ColumnPath> path = descr->path();
+        //Without an encoding set the writer picks PLAIN, or RLE for booleans in V2 pages
+        parquet::Encoding::type encoding = writerProps.encoding(path);
+        bool isDefault = encoding == parquet::Encoding::UNKNOWN;
+        if(chunk->compression() != writerProps.compression(path))
+            return false;
+        if(chunk->has_dictionary_page() && !writerProps.dictionary_enabled(path))
+            return false;
+        //Without page stats the encodings can't be told apart from the levels'
+        if(chunk->encoding_stats().empty())
+            return false;
+        for(auto& stats : chunk->encoding_stats()){
+            if(stats.page_type == parquet::PageType::DICTIONARY_PAGE)
+                continue;
+            if((stats.page_type == parquet::PageType::DATA_PAGE_V2) != pageV2)
+                return false;
+            if(isDictionary(stats.encoding) || stats.encoding == encoding)
+                continue;
+            if(!isDefault || (stats.encoding != parquet::Encoding::PLAIN &&
+                              (stats.encoding != parquet::Encoding::RLE || descr->physical_type() != parquet::Type::BOOLEAN)))
+                return false;
+        }
+    }
+    return true;
+}
+
+void COMPACT::copy(const Group& group, const std::vector<Input>& inputs,
+                   std::shared_ptr<arrow::io::OutputStream> sink,
+                   parquet::FileMetaDataBuilder& builder){
+    const Input& input = inputs[group.sources[0].input];
+    std::unique_ptr<parquet::RowGroupMetaData> rowGroup = input.reader->metadata()->RowGroup(group.sources[0].rowGroup);
+    std::vector<int64_t> shifts;
+    for(int i=0;i<rowGroup->num_columns();i++){
+        std::unique_ptr<parquet::ColumnChunkMetaData> chunk = rowGroup->ColumnChunk(i);
+        int64_t start = chunk->data_page_offset();
+        if(chunk->has_dictionary_page() && chunk->dictionary_page_offset() > 0)
+            start = std::min(start, chunk->dictionary_page_offset());
+        int64_t position;
+        PARQUET_ASSIGN_OR_THROW(position, sink->Tell());
+        shifts.push_back(position - start);
+        for(int64_t done=0;done<chunk->total_compressed_size();done+=copyBlock){
+            std::shared_ptr<arrow::Buffer> buffer;
+            PARQUET_ASSIGN_OR_THROW(buffer, input.file->ReadAt(start + done,
+                                                               std::min(copyBlock, chunk->total_compressed_size() - done)));
+            PARQUET_THROW_NOT_OK(sink->Write(buffer));
+        }
+    }
+    addRowGroup(builder, *rowGroup, shifts);
+}
+
+void COMPACT::encode(const Group& group, const std::vector<Input>& inputs,
+                     std::shared_ptr<arrow::io::OutputStream> sink,
+                     std::shared_ptr<parquet::WriterProperties> writerProps,
+                     parquet::FileMetaDataBuilder& builder){
+    const parquet::SchemaDescriptor* schema = inputs[0].reader->metadata()->schema();
+    int64_t start;
+    PARQUET_ASSIGN_OR_THROW(start, sink->Tell());
+    //The writer's row group goes straight to the output, its footer is dropped for the merged one
+    std::shared_ptr<Segment> segment = std::make_shared<Segment>(sink, start - 4);
+    std::shared_ptr<parquet::ParquetFileWriter> writer =
+        parquet::ParquetFileWriter::Open(segment, std::static_pointer_cast<GroupNode>(schema->schema_root()), writerProps);
+    parquet::RowGroupWriter* rowGroupWriter = writer->AppendRowGroup();
+    for(int i=0;i<schema->num_columns();i++){
+        parquet::ColumnWriter* columnWriter = rowGroupWriter->NextColumn();
+        for(auto& source : group.sources){
+            std::shared_ptr<parquet::ColumnReader> reader =
+                PREADER::column(inputs[source.input].reader->RowGroup(source.rowGroup), i);
+            encodeColumn(reader.get(), columnWriter);
+        }
+    }
+    rowGroupWriter->Close();
+    segment->discard();
+    writer->Close();
+    addRowGroup(builder, *writer->metadata()->RowGroup(0), std::vector<int64_t>(schema->num_columns(), 0));
+}
+
+void COMPACT::encodeColumn(parquet::ColumnReader* reader, parquet::ColumnWriter* writer){
+    switch(reader->type()){
+        case parquet::Type::BOOLEAN:
+            return encodeColumn<parquet::BooleanType>(reader, writer);
+        case parquet::Type::INT32:
+            return encodeColumn<parquet::Int32Type>(reader, writer);
+        case parquet::Type::INT64:
+            return encodeColumn<parquet::Int64Type>(reader, writer);
+        case parquet::Type::INT96:
+            return encodeColumn<parquet::Int96Type>(reader, writer);
+        case parquet::Type::FLOAT:
+            return encodeColumn<parquet::FloatType>(reader, writer);
+        case parquet::Type::DOUBLE:
+            return encodeColumn<parquet::DoubleType>(reader, writer);
+        case parquet::Type::BYTE_ARRAY:
+            return encodeColumn<parquet::ByteArrayType>(reader, writer);
+        case parquet::Type::FIXED_LEN_BYTE_ARRAY:
+            return encodeColumn<parquet::FLBAType>(reader, writer);
+        default:
+            throw std::runtime_error("Can't compact column " + reader->descr()->name());
+    }
+}
+
+template<typename T>
+void COMPACT::encodeColumn(parquet::ColumnReader* reader, parquet::ColumnWriter* writer){
+    //Values stay in their physical type, levels are passed through so nulls and lists are kept
+    auto typedReader = static_cast<parquet::TypedColumnReader<T>*>(reader);
+    auto typedWriter = static_cast<parquet::TypedColumnWriter<T>*>(writer);
+    std::vector<int16_t> defLevels(batchSize);
+    std::vector<int16_t> repLevels(batchSize);
+    std::unique_ptr<typename T::c_type[]> values {new typename T::c_type[batchSize]};
+    while(typedReader->HasNext()){
+        int64_t read;
+        int64_t levels = typedReader->ReadBatch(batchSize, defLevels.data(), repLevels.data(), values.get(), &read);
+        typedWriter->WriteBatch(levels, defLevels.data(), repLevels.data(), values.get());
+    }
+}
+
+void COMPACT::addRowGroup(parquet::FileMetaDataBuilder& builder,
+                          const parquet::RowGroupMetaData& rowGroup,
+                          const std::vector<int64_t>& shifts){
+    parquet::RowGroupMetaDataBuilder* rowGroupBuilder = builder.AppendRowGroup();
+    rowGroupBuilder->set_num_rows(rowGroup.num_rows());
+    for(int i=0;i<rowGroup.num_columns();i++){
+        std::unique_ptr<parquet::ColumnChunkMetaData> chunk = rowGroup.ColumnChunk(i);
+        parquet::ColumnChunkMetaDataBuilder* column = rowGroupBuilder->NextColumnChunk();
+        std::map<parquet::Encoding::type, int32_t> dictionaryStats;
+        std::map<parquet::Encoding::type, int32_t> dataStats;
+        bool fallback = false;
+        for(auto& stats : chunk->encoding_stats()){
+            if(stats.page_type == parquet::PageType::DICTIONARY_PAGE)
+                dictionaryStats[stats.encoding] += stats.count;
+            else{
+                dataStats[stats.encoding] += stats.count;
+                fallback |= chunk->has_dictionary_page() && !isDictionary(stats.encoding);
+            }
+        }
+        if(std::shared_ptr<parquet::EncodedStatistics> stats = chunk->encoded_statistics())
+            column->SetStatistics(*stats);
+        #if ARROW_VERSION_MAJOR >= 18
+        //Size statistics only exist from Arrow 18, older builds leave them out as their writers do
+        if(std::shared_ptr<parquet::SizeStatistics> sizes = chunk->size_statistics())
+            column->SetSizeStatistics(*sizes);
+        #endif
+        column->Finish(chunk->num_values(),
+                       chunk->has_dictionary_page() ? chunk->dictionary_page_offset() + shifts[i] : 0,
+                       0,
+                       chunk->data_page_offset() + shifts[i],
+                       chunk->total_compressed_size(),
+                       chunk->total_uncompressed_size(),
+                       chunk->has_dictionary_page(),
+                       fallback,
+                       dictionaryStats,
+                       dataStats);
+    }
+    rowGroupBuilder->Finish(rowGroup.total_byte_size());
+}
+
+std::shared_ptr<const parquet::KeyValueMetadata> COMPACT::keyValueMetadata(const std::vector<Input>& inputs){
+    //Keys of every input, the first file to have a key gives its value
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for(auto& input : inputs){
+        std::shared_ptr<const parquet::KeyValueMetadata> metadata = input.reader->metadata()->key_value_metadata();
+        if(!metadata)
+            continue;
+        for(int64_t i=0;i<metadata->size();i++){
+            if(std::find(keys.begin(), keys.end(), metadata->key(i)) != keys.end())
+                continue;
+            keys.push_back(metadata->key(i));
+            values.push_back(metadata->value(i));
+        }
+    }
+    if(keys.empty())
+        return NULLPTR;
+    return std::make_shared<const parquet::KeyValueMetadata>(keys, values);
+}
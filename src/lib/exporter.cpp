@@ -0,0 +1,245 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <exporter.hpp>
+#include <deque>
+#include <filesystem>
+
+using namespace KDB::PARQ;
+
+K EXPORTER::exportHdb(std::string root, K parts, K files, parquet::Compression::type codec,
+                      K metadata, K props){
+    //Enumeration domains are mapped from the root once, the first time a column uses them
+    std::map<std::string, K> domains;
+    //Read here as the workers can't touch q objects beyond the mapped columns
+    std::vector<WRITER::ColumnOption> columns = WRITER::ColumnOptions(props);
+    J threads = THREADS::workers();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Task> queue;
+    std::vector<Task> done;
+    J inFlight = 0;
+    bool finished = false;
+    std::string error;
+
+    std::vector<std::thread> workers;
+    for(J i=0;i<threads;i++)
+        workers.emplace_back([&](){
+            THREADS::pin();
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true){
+                cv.wait(lock, [&]{ return !queue.empty() || finished; });
+                if(queue.empty())
+                    return;
+                Task task = queue.front();
+                queue.pop_front();
+                THREADS::enqueued(-1);
+                lock.unlock();
+                std::string failure;
+                try{
+                    THREADS::Busy busy;
+                    writeTask(task, codec, metadata, props, columns);
+                }catch (const std::exception& e) {
+                    failure = e.what();
+                }
+                lock.lock();
+                if(!failure.empty() && error.empty())
+                    error = failure;
+                done.push_back(task);
+                inFlight--;
+                cv.notify_all();
+            }
+        });
+
+    K paths = ktn(KS, 0);
+    K rows = ktn(KJ, 0);
+    try{
+        for(J i=0;i<parts->n;i++){
+            //Mapping calls into q so it stays on the main thread, the workers only read the mapped columns
+            Task task = mapPartition(root, k2string(kK(parts)[i]), k2string(kK(files)[i]), domains);
+            js(&paths, ss(const_cast<S>(task.fileName.c_str())));
+            ja(&rows, &task.rows);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]{ return inFlight < threads || !error.empty(); });
+            //Unmapping the written partitions keeps the address space bounded
+            for(auto& written : done)
+                releaseTask(written);
+            done.clear();
+            if(!error.empty()){
+                releaseTask(task);
+                break;
+            }
+            queue.push_back(task);
+            THREADS::enqueued(1);
+            inFlight++;
+            cv.notify_all();
+        }
+    }catch (const std::exception& e) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(error.empty())
+            error = e.what();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished = true;
+        cv.notify_all();
+    }
+    for(auto& worker : workers)
+        worker.join();
+    for(auto& written : done)
+        releaseTask(written);
+    THREADS::enqueued(-static_cast<J>(queue.size()));
+    for(auto& task : queue)
+        releaseTask(task);
+    for(auto& domain : domains)
+        r0(domain.second);
+    if(!error.empty()){
+        r0(paths);
+        r0(rows);
+        throw std::runtime_error(error);
+    }
+    K names = ktn(KS, 2);
+    kS(names)[0] = ss(const_cast<S>("path"));
+    kS(names)[1] = ss(const_cast<S>("rows"));
+    return xT(xD(names, knk(2, paths, rows)));
+}
+
+K EXPORTER::mapFile(const std::string& path){
+    //get maps splayed column files rather than reading them into memory
+    std::string file = ":" + path;
+    K res = k(0, const_cast<S>("get"), ks(const_cast<S>(file.c_str())), (K)0);
+    if(!res)
+        throw std::runtime_error("Unable to map " + path);
+    if(res->t == -128){
+        std::string error = std::string{res->s} + ": " + path;
+        r0(res);
+        throw std::runtime_error(error);
+    }
+    return res;
+}
+
+K EXPORTER::domain(const std::string& root, K col, std::map<std::string, K>& domains){
+    //An enumeration only names its domain, which an HDB keeps in a file of that name at its root
+    K name = k(0, const_cast<S>("key"), r1(col), (K)0);
+    if(!name || name->t != -KS){
+        if(name) r0(name);
+        throw std::runtime_error("Unable to resolve enumeration domain");
+    }
+    std::string domainName = name->s;
+    r0(name);
+    auto found = domains.find(domainName);
+    if(found != domains.end())
+        return found->second;
+    K syms = mapFile(root + "/" + domainName);
+    if(syms->t != KS){
+        r0(syms);
+        throw std::runtime_error("Enumeration domain must hold a sym list: " + domainName);
+    }
+    domains[domainName] = syms;
+    return syms;
+}
+
+EXPORTER::Task EXPORTER::mapPartition(const std::string& root, const std::string& dir, const std::string& fileName,
+                                      std::map<std::string, K>& domains){
+    K names = mapFile(dir + "/.d");
+    if(names->t != KS){
+        r0(names);
+        throw std::runtime_error(".d must hold a sym list: " + dir);
+    }
+    Task task {fileName, names, ktn(0, 0), ktn(0, 0), 0};
+    try{
+        for(J i=0;i<names->n;i++){
+            K col = mapFile(dir + "/" + kS(names)[i]);
+            if(77 <= col->t && col->t <= 96){
+                //Nested columns map as one object over the data and its index, the workers can
+                //only read them as lists of vectors so they are brought into memory here
+                K items = k(0, const_cast<S>("{x til count x}"), col, (K)0);
+                if(!items || items->t != 0){
+                    std::string error = items && items->t == -128 ? std::string{items->s} + ": " : "";
+                    if(items) r0(items);
+                    throw std::runtime_error(error + "Unable to read nested column " + kS(names)[i]);
+                }
+                col = items;
+            }
+            jk(&task.cols, col);
+            jk(&task.domains, 20 <= col->t && col->t <= 76 ? r1(domain(root, col, domains)) : ktn(0, 0));
+            if(col->t < 0 || col->t > 76)
+                throw std::runtime_error(std::string{"Unsupported column type: "} + kS(names)[i]);
+            if(i && col->n != task.rows)
+                throw std::runtime_error(std::string{"Column length mismatch: "} + dir + "/" + kS(names)[i]);
+            task.rows = col->n;
+        }
+    }catch (const std::exception& e) {
+        releaseTask(task);
+        throw;
+    }
+    return task;
+}
+
+void EXPORTER::releaseTask(Task& task){
+    r0(task.names);
+    r0(task.cols);
+    r0(task.domains);
+}
+
+void EXPORTER::writeTask(const Task& task, parquet::Compression::type codec, K metadata, K props,
+                         const std::vector<WRITER::ColumnOption>& columns){
+    std::filesystem::create_directories(std::filesystem::path(task.fileName).parent_path());
+    std::shared_ptr<GroupNode> schema = WRITER::SetupSchema(task.names, task.cols, task.cols->n,
+                                                            dictBool(props, "nullable", false));
+    std::shared_ptr<arrow::io::OutputStream> sink;
+    std::shared_ptr<parquet::ParquetFileWriter> fileWriter = WRITER::OpenFile(task.fileName, schema, codec,
+                                                                              false, metadata, props, columns, sink);
+    std::vector<PSTREAM::ColumnBuffer> buffers(task.cols->n);
+    for(J i=0;i<task.cols->n;i++){
+        int type = kK(task.cols)[i]->t;
+        buffers[i].type = 20 <= type && type <= 76 ? KS : type;
+        buffers[i].itemType = fileWriter->schema()->Column(i)->max_repetition_level() > 0 ?
+                              WRITER::listType(kK(task.cols)[i]) : 0;
+        buffers[i].optional = fileWriter->schema()->Column(i)->max_definition_level() > (buffers[i].itemType ? 1 : 0);
+    }
+
+    //Only a row group's worth of each column is converted at a time, the rest stays mapped on disk
+    J chunk = std::max<J>(1, dictLong(props, "rowGroupSize", 1048576));
+    std::vector<S> resolved;
+    for(J offset=0;offset<task.rows;offset+=chunk){
+        J len = std::min(chunk, task.rows - offset);
+        parquet::RowGroupWriter* rg_writer = fileWriter->AppendRowGroup();
+        for(J i=0;i<task.cols->n;i++){
+            K col = kK(task.cols)[i];
+            PSTREAM::ColumnBuffer& buffer = buffers[i];
+            PSTREAM::clearColumn(buffer);
+            if(20 <= col->t && col->t <= 76){
+                K syms = kK(task.domains)[i];
+                resolved.resize(len);
+                for(J j=0;j<len;j++){
+                    J index = kJ(col)[offset + j];
+                    if(index < 0 || index >= syms->n)
+                        throw std::runtime_error(std::string{"Enumeration index out of range of its domain: "} + kS(task.names)[i]);
+                    resolved[j] = kS(syms)[index];
+                }
+                PSTREAM::appendSyms(buffer, resolved.data(), len);
+            } else
+                PSTREAM::appendColumn(buffer, col, offset, len);
+            PSTREAM::writeBuffer(buffer, len, rg_writer->NextColumn());
+        }
+        rg_writer->Close();
+    }
+    WRITER::CloseFile(fileWriter, sink);
+}
@@ -27,6 +27,7 @@ PKDB::PKDB(std::shared_ptr<parquet::ParquetFileReader> filerReader)
     currentRowGroup=0;
     row_group_reader=filerReader_->RowGroup(currentRowGroup);
     key_value_metadata=filerReader_->metadata()->key_value_metadata();
+    plan_=PREADER::plan(filerReader_->metadata()->schema());
     totalRowGroups=filerReader_->metadata()->num_row_groups();
 }
 
@@ -35,10 +36,10 @@ PKDB::~PKDB(){
     filerReader_->Close();
 }
 
-K PKDB::loadReader(std::string fileName){
+K PKDB::loadReader(std::string fileName, K props){
     try {
         if(instance) instance->~PKDB();
-        instance = new PKDB { PREADER::open_reader(fileName.c_str()) };
+        instance = new PKDB { PREADER::open_reader(fileName.c_str(), props) };
         updateMetaData();
         return kb(1);
     } catch (const std::exception& e) {
@@ -47,14 +48,17 @@ K PKDB::loadReader(std::string fileName){
     }
 }
 
-K PKDB::readGroup(std::string fileName, int group, K cols){
+K PKDB::readGroup(std::string fileName, int group, K cols, K props){
     try {
-        std::shared_ptr<parquet::ParquetFileReader> filerReader = PREADER::open_reader(fileName.c_str());
+        std::shared_ptr<parquet::ParquetFileReader> filerReader = PREADER::open_reader(fileName.c_str(), props);
+        //Row group readers only see the buffered ranges if created after pre-buffering
+        PREADER::preBuffer(filerReader, {group}, PREADER::columnIndices(filerReader, cols), props);
         std::shared_ptr<parquet::RowGroupReader> row_group_reader = filerReader->RowGroup(group);
         return readTable(row_group_reader,
 						 cols->n ? cols->n : row_group_reader->metadata()->num_columns(),
 						 row_group_reader->metadata()->num_rows(),
-						 cols);
+						 cols,
+						 *PREADER::plan(filerReader->metadata()->schema()));
         filerReader->Close();
     } catch (const std::exception& e) {
             char* error = const_cast<char*>(e.what());
@@ -71,7 +75,9 @@ void PKDB::updateMetaData(){
 K PKDB::readTable(std::shared_ptr<parquet::RowGroupReader> row_group_reader,
                                          int num_cols,
                                          int num_rows,
-                                         K cols){
+                                         K cols,
+                                         const PREADER::Plan& plan){
+    STATS_SPAN("readTable");
     //This will hold the column names
     K colNames = ktn(KS,num_cols);
     //This will hold column values
@@ -81,7 +87,7 @@ K PKDB::readTable(std::shared_ptr<parquet::RowGroupReader> row_group_reader,
         int index = cols->n ? getColIndex(row_group_reader, std::string{kS(cols)[i]}) : i;
 		if(index < 0) return krr(kS(cols)[i]);
         kS(colNames)[i] = PKDB::readColName(row_group_reader, index);
-        jk(&colValues, PKDB::getColData(row_group_reader, index, num_rows));
+        jk(&colValues, PKDB::getColData(row_group_reader, index, num_rows, plan[index]));
     }
 
     //Return a table to the process
@@ -89,15 +95,18 @@ K PKDB::readTable(std::shared_ptr<parquet::RowGroupReader> row_group_reader,
 }
 
 int PKDB::getColIndex(std::shared_ptr<parquet::RowGroupReader> row_group_reader, std::string colName){
-    return row_group_reader->metadata()->schema()->ColumnIndex(colName);
+    return PREADER::columnIndex(row_group_reader->metadata()->schema(), colName);
 }
 
 S PKDB::readColName(std::shared_ptr<parquet::RowGroupReader> row_group_reader, int index){
-    return ss(const_cast<char*>(row_group_reader->metadata()->schema()->Column(index)->name().c_str()));
+    return ss(const_cast<char*>(PREADER::columnName(row_group_reader->metadata()->schema()->Column(index)).c_str()));
 }
 
-K PKDB::getColData(std::shared_ptr<parquet::RowGroupReader> row_group_reader, int index, int num_rows){
-	return PREADER::readColumns(row_group_reader->Column(index), num_rows);
+K PKDB::getColData(std::shared_ptr<parquet::RowGroupReader> row_group_reader, int index, int num_rows,
+                   const PREADER::Decoder& decoder){
+    //Counted from creating the column reader, which is where an unbuffered chunk is read
+    STATS_COLUMN("read", PREADER::columnName(row_group_reader->metadata()->schema()->Column(index)));
+	return PREADER::readColumns(decoder, PREADER::column(row_group_reader, index), num_rows);
 }
 
 K PKDB::close(){
@@ -108,16 +117,17 @@ K PKDB::close(){
 
 PWRITE* PWRITE::instance;
 
-PWRITE::PWRITE(std::shared_ptr<parquet::ParquetFileWriter> fileWriter)
-        : fileWriter_(fileWriter)
+PWRITE::PWRITE(std::shared_ptr<parquet::ParquetFileWriter> fileWriter,
+               std::shared_ptr<arrow::io::OutputStream> sink, std::string fileName, bool summary,
+               std::shared_ptr<APPEND::State> append)
+        : fileWriter_(fileWriter), sink_(sink), fileName_(fileName), summary_(summary), append_(append)
 {
     //When opening files, point at the first row group
     currentRowGroup=0;
 }
 
 PWRITE::~PWRITE(){
-    //Close the FD
-    fileWriter_->Close();
+    //The writer and its sink are closed by close, where their errors can be returned
 }
 
 std::shared_ptr<parquet::ParquetFileWriter> PWRITE::open_file_writer(K colNames, 
@@ -126,39 +136,95 @@ std::shared_ptr<parquet::ParquetFileWriter> PWRITE::open_file_writer(K colNames,
                                                                      bool single,
                                                                      parquet::Compression::type codec,
                                                                      bool append,
-                                                                     K metadata){
-    if(!instance || single)
-        return WRITER::OpenFile(fileName, WRITER::SetupSchema(colNames, colValues, colValues->n),
-                                codec, append, metadata);
-    else
-        return instance->fileWriter_;
+                                                                     K metadata,
+                                                                     K props,
+                                                                     std::shared_ptr<arrow::io::OutputStream>& sink,
+                                                                     std::shared_ptr<APPEND::State>& state){
+    if(!instance || single){
+        std::shared_ptr<GroupNode> schema = WRITER::SetupSchema(colNames, colValues, colValues->n,
+                                                                dictBool(props, "nullable", false));
+        if(!append)
+            return WRITER::OpenFile(fileName, schema, codec, append, metadata, props,
+                                    WRITER::ColumnOptions(props), sink);
+        state = std::make_shared<APPEND::State>();
+        std::shared_ptr<parquet::ParquetFileWriter> writer = APPEND::open(fileName, schema, codec, metadata, props, *state);
+        sink = state->sink;
+        return writer;
+    }
+    sink = instance->sink_;
+    return instance->fileWriter_;
 }
 
 K PWRITE::write(K table, std::string fileName, bool single, 
-                parquet::Compression::type codec, bool append, K metadata){
+                parquet::Compression::type codec, bool append, K metadata, K props){
+    std::shared_ptr<APPEND::State> state;
     try{
+        STATS_SPAN("write");
         K colValues=kK(table->k)[1];
         K colNames=kK(table->k)[0];
+        std::shared_ptr<arrow::io::OutputStream> sink;
         std::shared_ptr<parquet::ParquetFileWriter> file_writer = open_file_writer(colNames, colValues,
                                                                                    fileName, single,
-                                                                                   codec, append, metadata);
+                                                                                   codec, append, metadata, props,
+                                                                                   sink, state);
         if(!instance && !single)
-            instance = new PWRITE {file_writer};
+            instance = new PWRITE {file_writer, sink, fileName, dictBool(props, "summary", false), state};
 
         parquet::RowGroupWriter* rg_writer = file_writer->AppendRowGroup();
         for(int i=0;i<colValues->n;i++)
                 WRITER::writeColumn(kK(colValues)[i], rg_writer);
 
-        if(single) file_writer->Close();
+        if(single){
+            std::shared_ptr<parquet::FileMetaData> written;
+            if(state)
+                written = APPEND::finish(*state, file_writer);
+            else{
+                WRITER::CloseFile(file_writer, sink);
+                written = file_writer->metadata();
+            }
+            if(dictBool(props, "summary", false))
+                SUMMARY::update(fileName, written);
+        }
         return kb(1);
     }catch (const std::exception& e) {
+            //The writer is gone by now unless a multi write kept it, put the old footer back
+            //once the sink has let go of the file
+            if(state && (single || !instance || instance->append_ != state)){
+                state->sink.reset();
+                APPEND::recover(fileName);
+            }
             char* error = const_cast<char*>(e.what());
             return orr(error);
     }        
 }
 
 K PWRITE::close(){
-    if(instance) instance->~PWRITE();
+    if(!instance)
+        return kb(1);
+    std::shared_ptr<parquet::ParquetFileWriter> fileWriter = instance->fileWriter_;
+    std::shared_ptr<arrow::io::OutputStream> sink = instance->sink_;
+    std::string fileName = instance->fileName_;
+    bool summary = instance->summary_;
+    std::shared_ptr<APPEND::State> append = instance->append_;
+    instance->~PWRITE();
     instance=nullptr;
+    std::shared_ptr<parquet::FileMetaData> written;
+    if(append){
+        try{
+            written = APPEND::finish(*append, fileWriter);
+        }catch(...){
+            fileWriter.reset();
+            sink.reset();
+            append->sink.reset();
+            APPEND::recover(fileName);
+            throw;
+        }
+    }
+    else{
+        WRITER::CloseFile(fileWriter, sink);
+        written = fileWriter->metadata();
+    }
+    if(summary)
+        SUMMARY::update(fileName, written);
     return kb(1);
 }
\ No newline at end of file
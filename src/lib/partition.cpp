@@ -0,0 +1,301 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <partition.hpp>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <thread>
+
+using namespace KDB::PARQ;
+
+K PARTITION::write(K table, std::string root, K partCols,
+                   parquet::Compression::type codec, K metadata, K props){
+    K colNames = kK(table->k)[0];
+    K colValues = kK(table->k)[1];
+    J len = colValues->n ? kK(colValues)[0]->n : 0;
+    for(int i=0;i<partCols->n;i++){
+        S* name = std::find(kS(colNames), kS(colNames) + colNames->n, kS(partCols)[i]);
+        if(name == kS(colNames) + colNames->n)
+            throw std::runtime_error(std::string{"Partition column not in table: "} + kS(partCols)[i]);
+        if(!partitionable(kK(colValues)[name - kS(colNames)]))
+            throw std::runtime_error(std::string{"Unsupported partition column type: "} + kS(partCols)[i]);
+    }
+
+    //A single stable sort groups the rows, keeping their order within each partition
+    std::vector<SORTER::Key> keys = SORTER::sortKeys(table, partCols);
+    std::vector<J> index(len);
+    std::iota(index.begin(), index.end(), 0);
+    SORTER::parallelSort(index.data(), len, keys);
+
+    bool drop = dictBool(props, "dropPartitionColumns", true);
+    J maxOpen = std::max<J>(1, dictLong(props, "maxOpenFiles", 64));
+    J threads = std::max<J>(1, std::min<J>(maxOpen, THREADS::workers()));
+
+    //Enumerations and column options are resolved here as the workers can't call back into q
+    std::vector<WRITER::ColumnOption> columns = WRITER::ColumnOptions(props);
+    std::vector<int> body;
+    std::vector<K> domains;
+    K bodyNames = ktn(KS, 0);
+    for(int i=0;i<colNames->n;i++){
+        if(drop && std::find(kS(partCols), kS(partCols) + partCols->n, kS(colNames)[i]) != kS(partCols) + partCols->n)
+            continue;
+        K col = kK(colValues)[i];
+        body.push_back(i);
+        domains.push_back(20 <= col->t && col->t <= 76 ? WRITER::enumDomain(col) : nullptr);
+        js(&bodyNames, kS(colNames)[i]);
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Task> queue;
+    std::vector<Task> done;
+    J inFlight = 0;
+    bool finished = false;
+    std::string error;
+
+    //Tasks count as in flight from queueing until written, which bounds both open files and memory
+    std::vector<std::thread> workers;
+    for(J i=0;i<threads;i++)
+        workers.emplace_back([&](){
+            THREADS::pin();
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true){
+                cv.wait(lock, [&]{ return !queue.empty() || finished; });
+                if(queue.empty())
+                    return;
+                Task task = queue.front();
+                queue.pop_front();
+                THREADS::enqueued(-1);
+                lock.unlock();
+                std::string failure;
+                try{
+                    THREADS::Busy busy;
+                    writeTask(task, codec, metadata, props, columns);
+                }catch (const std::exception& e) {
+                    failure = e.what();
+                }
+                lock.lock();
+                if(!failure.empty() && error.empty())
+                    error = failure;
+                done.push_back(task);
+                inFlight--;
+                cv.notify_all();
+            }
+        });
+
+    K paths = ktn(KS, 0);
+    K rows = ktn(KJ, 0);
+    try{
+        J start = 0;
+        for(J i=1;i<=len;i++){
+            if(i < len && !SORTER::lessThan(keys, index[i-1], index[i]))
+                continue;
+            std::string dir = root + "/" + directory(keys, partCols, index[start]);
+            std::filesystem::create_directories(dir);
+            Task task {nextFile(dir), nullptr, i - start};
+            K values = ktn(0, 0);
+            for(size_t j=0;j<body.size();j++)
+                jk(&values, gather(kK(colValues)[body[j]], domains[j], &index[start], i - start));
+            task.table = xT(xD(r1(bodyNames), values));
+            js(&paths, ss(const_cast<S>(task.fileName.c_str())));
+            ja(&rows, &task.rows);
+            start = i;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]{ return inFlight < maxOpen || !error.empty(); });
+            //Written partitions are released on the main thread, K memory isn't shared with the workers
+            for(auto& written : done)
+                r0(written.table);
+            done.clear();
+            if(!error.empty()){
+                r0(task.table);
+                break;
+            }
+            queue.push_back(task);
+            THREADS::enqueued(1);
+            inFlight++;
+            cv.notify_all();
+        }
+    }catch (const std::exception& e) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(error.empty())
+            error = e.what();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished = true;
+        cv.notify_all();
+    }
+    for(auto& worker : workers)
+        worker.join();
+    for(auto& written : done)
+        r0(written.table);
+    THREADS::enqueued(-static_cast<J>(queue.size()));
+    for(auto& task : queue)
+        r0(task.table);
+    for(auto domain : domains)
+        if(domain) r0(domain);
+    SORTER::releaseKeys(keys);
+    r0(bodyNames);
+    if(!error.empty()){
+        r0(paths);
+        r0(rows);
+        throw std::runtime_error(error);
+    }
+    K names = ktn(KS, 2);
+    kS(names)[0] = ss(const_cast<S>("path"));
+    kS(names)[1] = ss(const_cast<S>("rows"));
+    return xT(xD(names, knk(2, paths, rows)));
+}
+
+void PARTITION::writeTask(const Task& task, parquet::Compression::type codec, K metadata, K props,
+                          const std::vector<WRITER::ColumnOption>& columns){
+    K colNames = kK(task.table->k)[0];
+    K colValues = kK(task.table->k)[1];
+    std::shared_ptr<GroupNode> schema = WRITER::SetupSchema(colNames, colValues, colValues->n,
+                                                            dictBool(props, "nullable", false));
+    std::shared_ptr<arrow::io::OutputStream> sink;
+    std::shared_ptr<parquet::ParquetFileWriter> fileWriter = WRITER::OpenFile(task.fileName, schema, codec,
+                                                                              false, metadata, props, columns, sink);
+    parquet::RowGroupWriter* rg_writer = fileWriter->AppendRowGroup();
+    for(int i=0;i<colValues->n;i++)
+        WRITER::writeColumn(kK(colValues)[i], rg_writer);
+    WRITER::CloseFile(fileWriter, sink);
+}
+
+std::string PARTITION::directory(const std::vector<SORTER::Key>& keys, K names, J row){
+    std::string dir;
+    for(size_t i=0;i<keys.size();i++)
+        dir += (i ? "/" : "") + escape(kS(names)[i]) + "=" + format(keys[i], row);
+    return dir;
+}
+
+std::string PARTITION::format(const SORTER::Key& key, J row){
+    //Nulls get the directory name Hive and other engines read back as null
+    static const std::string null {"__HIVE_DEFAULT_PARTITION__"};
+    K col = key.col;
+    switch(col->t){
+        case KB:
+            return kG(col)[row] ? "true" : "false";
+        case KG:
+            return std::to_string(kG(col)[row]);
+        case KH:
+            return kH(col)[row] == nh ? null : std::to_string(kH(col)[row]);
+        case KI:
+            return kI(col)[row] == ni ? null : std::to_string(kI(col)[row]);
+        case KJ:
+            return kJ(col)[row] == nj ? null : std::to_string(kJ(col)[row]);
+        case KD:
+            return kI(col)[row] == ni ? null : date(kI(col)[row], false);
+        case KM:
+            return kI(col)[row] == ni ? null : date(kI(col)[row], true);
+        case KS:
+            return *kS(col)[row] ? escape(kS(col)[row]) : null;
+        case 0:
+            return kK(col)[row]->n ? escape(std::string(reinterpret_cast<char*>(kG(kK(col)[row])), kK(col)[row]->n)) : null;
+        default:{
+            S sym = kS(key.domain)[kJ(col)[row]];
+            return *sym ? escape(sym) : null;
+        }
+    }
+}
+
+std::string PARTITION::escape(const std::string& value){
+    //Same characters Hive percent encodes in partition paths
+    static const std::string special {"\"#%'*/:=?\\{[]^"};
+    std::string res;
+    char hex[4];
+    for(unsigned char c : value){
+        if(c < 0x20 || c == 0x7F || special.find(c) != std::string::npos){
+            std::snprintf(hex, sizeof(hex), "%%%02X", c);
+            res += hex;
+        } else
+            res += c;
+    }
+    return res;
+}
+
+std::string PARTITION::date(I days, bool month){
+    char res[16];
+    if(month){
+        I year = 2000 + (days >= 0 ? days / 12 : (days - 11) / 12);
+        std::snprintf(res, sizeof(res), "%04d-%02d", year, days - (year - 2000) * 12 + 1);
+        return res;
+    }
+    //Civil date from days since 2000.01.01
+    J z = days + 730425;
+    J era = (z >= 0 ? z : z - 146096) / 146097;
+    J doe = z - era * 146097;
+    J yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    J doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    J mp = (5 * doy + 2) / 153;
+    J d = doy - (153 * mp + 2) / 5 + 1;
+    J m = mp < 10 ? mp + 3 : mp - 9;
+    std::snprintf(res, sizeof(res), "%04lld-%02lld-%02lld", yoe + era * 400 + (m <= 2), m, d);
+    return res;
+}
+
+std::string PARTITION::nextFile(const std::string& dir){
+    //Earlier writes into the same partition are kept, new rows go in the next part
+    for(int i=0;;i++){
+        std::string fileName = dir + "/part-" + std::to_string(i) + ".parquet";
+        if(!std::filesystem::exists(fileName))
+            return fileName;
+    }
+}
+
+K PARTITION::gather(K col, K domain, const J* index, J len){
+    if(domain){
+        K res = ktn(KS, len);
+        for(J i=0;i<len;i++){
+            J value = kJ(col)[index[i]];
+            if(value < 0 || value >= domain->n){
+                r0(res);
+                throw std::runtime_error("Enumeration index out of range of its domain");
+            }
+            kS(res)[i] = kS(domain)[value];
+        }
+        return res;
+    }
+    if(col->t == 0){
+        K res = ktn(0, len);
+        for(J i=0;i<len;i++)
+            kK(res)[i] = r1(kK(col)[index[i]]);
+        return res;
+    }
+    int size = col->t == KB || col->t == KG || col->t == KC ? 1 :
+               col->t == KH ? 2 :
+               col->t == KI || col->t == KE || col->t == KM || col->t == KD ||
+               col->t == KU || col->t == KV || col->t == KT ? 4 :
+               col->t == UU ? 16 : 8;
+    K res = ktn(col->t, len);
+    for(J i=0;i<len;i++)
+        std::memcpy(kG(res) + i * size, kG(col) + index[i] * size, size);
+    return res;
+}
+
+bool PARTITION::partitionable(K col){
+    switch(col->t){
+        case KB: case KG: case KH: case KI: case KJ: case KS: case KD: case KM:
+            return true;
+        case 0:
+            return std::all_of(kK(col), kK(col) + col->n, [](K item){ return item->t == KC; });
+        default:
+            return 20 <= col->t && col->t <= 76;
+    }
+}
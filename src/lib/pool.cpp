@@ -0,0 +1,161 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <pool.hpp>
+
+using namespace KDB::PARQ;
+
+POOL::POOL(arrow::MemoryPool* base)
+        : base_(base), limit(0), cacheLimit(0), cacheMin(1 << 20), allocated(0), cached(0),
+          peak(0), total(0), allocations(0), reused(0), operationPeak(0), operationTotal(0)
+{
+}
+
+POOL& POOL::getInstance(){
+    //Never destroyed, buffers can still be freed into it while the process exits
+    static POOL* instance = new POOL {arrow::default_memory_pool()};
+    return *instance;
+}
+
+arrow::Status POOL::Allocate(int64_t size, int64_t alignment, uint8_t** out){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(cacheLimit && size >= cacheMin && alignment == arrow::kDefaultBufferAlignment){
+        auto it = cache.find(size);
+        if(it != cache.end()){
+            *out = it->second;
+            cache.erase(it);
+            cached -= size;
+            reused++;
+            account(size);
+            return arrow::Status::OK();
+        }
+    }
+    ARROW_RETURN_NOT_OK(reserve(size));
+    ARROW_RETURN_NOT_OK(base_->Allocate(size, alignment, out));
+    account(size);
+    return arrow::Status::OK();
+}
+
+arrow::Status POOL::Reallocate(int64_t old_size, int64_t new_size, int64_t alignment, uint8_t** ptr){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(new_size > old_size)
+        ARROW_RETURN_NOT_OK(reserve(new_size - old_size));
+    ARROW_RETURN_NOT_OK(base_->Reallocate(old_size, new_size, alignment, ptr));
+    allocated += new_size - old_size;
+    if(new_size > old_size){
+        total += new_size - old_size;
+        operationTotal += new_size - old_size;
+    }
+    peak = std::max(peak, allocated);
+    operationPeak = std::max(operationPeak, allocated);
+    return arrow::Status::OK();
+}
+
+void POOL::Free(uint8_t* buffer, int64_t size, int64_t alignment){
+    std::lock_guard<std::mutex> lock(mutex);
+    allocated -= size;
+    if(cacheLimit && size >= cacheMin && alignment == arrow::kDefaultBufferAlignment && cached + size <= cacheLimit){
+        cache.emplace(size, buffer);
+        cached += size;
+        return;
+    }
+    base_->Free(buffer, size, alignment);
+}
+
+void POOL::ReleaseUnused(){
+    std::lock_guard<std::mutex> lock(mutex);
+    releaseCache();
+    base_->ReleaseUnused();
+}
+
+int64_t POOL::bytes_allocated() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return allocated;
+}
+
+int64_t POOL::max_memory() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return peak;
+}
+
+int64_t POOL::total_bytes_allocated() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return total;
+}
+
+int64_t POOL::num_allocations() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return allocations;
+}
+
+std::string POOL::backend_name() const{
+    return "ParQ(" + base_->backend_name() + ")";
+}
+
+void POOL::configure(int64_t limit, int64_t cacheLimit, int64_t cacheMin){
+    std::lock_guard<std::mutex> lock(mutex);
+    this->limit = limit;
+    this->cacheLimit = cacheLimit;
+    this->cacheMin = cacheMin;
+    releaseCache();
+}
+
+void POOL::begin(){
+    std::lock_guard<std::mutex> lock(mutex);
+    operationPeak = allocated;
+    operationTotal = 0;
+}
+
+K POOL::stats(){
+    std::lock_guard<std::mutex> lock(mutex);
+    K keys = ktn(KS, 0);
+    for(auto key : {"limit", "allocated", "peak", "total", "allocations", "cached", "reused",
+                    "operationPeak", "operationTotal"})
+        js(&keys, ss(const_cast<S>(key)));
+    K values = ktn(KJ, 0);
+    for(J value : {limit, allocated, peak, total, allocations, cached, reused, operationPeak, operationTotal})
+        ja(&values, &value);
+    return xD(keys, values);
+}
+
+arrow::Status POOL::reserve(int64_t size){
+    if(!limit || allocated + cached + size <= limit)
+        return arrow::Status::OK();
+    //Cached buffers count against the limit, so give them back before failing
+    releaseCache();
+    if(allocated + size <= limit)
+        return arrow::Status::OK();
+    return arrow::Status::OutOfMemory("ParQ memory limit of ", limit, " bytes exceeded allocating ", size,
+                                      " bytes with ", allocated, " in use, see .pq.memory.setLimit");
+}
+
+void POOL::account(int64_t size){
+    allocated += size;
+    total += size;
+    operationTotal += size;
+    allocations++;
+    STATS_ADD(allocations, 1);
+    STATS_ADD(allocBytes, size);
+    peak = std::max(peak, allocated);
+    operationPeak = std::max(operationPeak, allocated);
+}
+
+void POOL::releaseCache(){
+    for(auto& buffer : cache)
+        base_->Free(buffer.second, buffer.first, arrow::kDefaultBufferAlignment);
+    cache.clear();
+    cached = 0;
+}
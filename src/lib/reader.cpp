@@ -15,140 +15,325 @@
 */
 
 #include <reader.hpp>
+#include <mutex>
+#include <unordered_map>
 
 using namespace KDB::PARQ;
 
-std::shared_ptr<parquet::ParquetFileReader> PREADER::open_reader(const std::string& path){
-    return parquet::ParquetFileReader::OpenFile(path, false);
+std::shared_ptr<parquet::ParquetFileReader> PREADER::open_reader(const std::string& path, K props){
+    std::shared_ptr<arrow::io::RandomAccessFile> file;
+    if(dictBool(props, "uring", false)){
+        PARQUET_ASSIGN_OR_THROW(file, URINGFILE::Open(path, dictBool(props, "directIO", false),
+                                                      dictLong(props, "uringDepth", 64),
+                                                      dictLong(props, "uringBlockSize", 1 << 20),
+                                                      &POOL::getInstance()));
+    }else{
+        PARQUET_ASSIGN_OR_THROW(file, arrow::io::ReadableFile::Open(path, &POOL::getInstance()));
+    }
+    return parquet::ParquetFileReader::Open(STATS::file(file), parquet::ReaderProperties(&POOL::getInstance()));
+}
+
+std::shared_ptr<parquet::ColumnReader> PREADER::column(std::shared_ptr<parquet::RowGroupReader> row_group_reader,
+                                                       int index){
+    #ifdef PARQ_STATS
+    //The reader RowGroupReader::Column makes, over pages that are counted and timed
+    return parquet::ColumnReader::Make(row_group_reader->metadata()->schema()->Column(index),
+                                       STATS::pages(row_group_reader->GetColumnPageReader(index)),
+                                       &POOL::getInstance());
+    #else
+    return row_group_reader->Column(index);
+    #endif
+}
+
+std::vector<int> PREADER::columnIndices(std::shared_ptr<parquet::ParquetFileReader> reader, K cols){
+    std::vector<int> columns;
+    const parquet::SchemaDescriptor* schema = reader->metadata()->schema();
+    if(cols->t != KS || !cols->n){
+        for(int i=0;i<schema->num_columns();i++)
+            columns.push_back(i);
+        return columns;
+    }
+    for(int i=0;i<cols->n;i++){
+        int index = columnIndex(schema, kS(cols)[i]);
+        if(index >= 0)
+            columns.push_back(index);
+    }
+    return columns;
 }
 
-K PREADER::readColumns(std::shared_ptr<parquet::ColumnReader> column_reader,
-                        int rowCount ){
-    switch(column_reader->type()){
+int PREADER::columnIndex(const parquet::SchemaDescriptor* schema, const std::string& name){
+    int index = schema->ColumnIndex(name);
+    if(index >= 0)
+        return index;
+    //Lists are named by their field rather than the path to their element
+    for(int i=0;i<schema->num_columns();i++)
+        if(schema->Column(i)->max_repetition_level() > 0 && columnName(schema->Column(i)) == name)
+            return i;
+    return -1;
+}
+
+std::string PREADER::columnName(const parquet::ColumnDescriptor* descr){
+    return descr->max_repetition_level() > 0 ? descr->path()->ToDotVector()[0] : descr->name();
+}
+
+bool PREADER::preBuffer(std::shared_ptr<parquet::ParquetFileReader> reader, const std::vector<int>& rowGroups,
+                        const std::vector<int>& columns, K props){
+    if(!dictBool(props, "preBuffer", false) || columns.empty())
+        return false;
+    //Byte ranges of every column chunk are merged across small holes and read concurrently on the IO pool
+    arrow::io::CacheOptions options = arrow::io::CacheOptions::Defaults();
+    options.hole_size_limit = dictLong(props, "holeSizeLimit", options.hole_size_limit);
+    options.range_size_limit = dictLong(props, "rangeSizeLimit", options.range_size_limit);
+    options.lazy = false;
+    reader->PreBuffer(rowGroups, columns, arrow::io::IOContext(&POOL::getInstance()), options);
+    //Surface read errors before any decoding starts
+    PARQUET_THROW_NOT_OK(reader->WhenBuffered(rowGroups, columns).status());
+    return true;
+}
+
+std::shared_ptr<const PREADER::Plan> PREADER::plan(const parquet::SchemaDescriptor* schema){
+    //Files written with the same schema share one plan, kept by the schema's printed form
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::shared_ptr<const Plan>> plans;
+    std::string key = schema->ToString();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = plans.find(key);
+    if(found != plans.end())
+        return found->second;
+    auto built = std::make_shared<Plan>();
+    for(int i=0;i<schema->num_columns();i++)
+        built->push_back(decoder(schema->Column(i)));
+    if(plans.size() >= maxPlans)
+        plans.clear();
+    plans.emplace(std::move(key), built);
+    return built;
+}
+
+PREADER::Decoder PREADER::decoder(const parquet::ColumnDescriptor* descr){
+    const std::shared_ptr<const LogicalType>& logical = descr->logical_type();
+    bool list = descr->max_repetition_level() > 0;
+    if(descr->max_repetition_level() > 1)
+        return {unsupported, 0, 1, 0};
+    switch(descr->physical_type()){
         case Type::BOOLEAN:
-            return getCol(static_cast<parquet::BoolReader*>(column_reader.get()), rowCount, KB, getBoolCol);
+            return numeric<parquet::BooleanType, bool, 1, 0>(KB, list);
         case Type::INT32:
-            switch(column_reader->descr()->logical_type()->type()){
-                case parquet::LogicalType::Type::DATE:
-                    return getCol(static_cast<parquet::Int32Reader*>(column_reader.get()), rowCount, KD, getDateCol);
-                case parquet::LogicalType::Type::TIME:
-                    return getCol(static_cast<parquet::Int32Reader*>(column_reader.get()), rowCount, KT, getIntCol);
-                case parquet::LogicalType::Type::INT:
-                    if(column_reader->descr()->logical_type()->is_compatible(parquet::ConvertedType::INT_16))
-                        return getCol(static_cast<parquet::Int32Reader*>(column_reader.get()), rowCount, KH, getShortCol);
-                default:
-                    return getCol(static_cast<parquet::Int32Reader*>(column_reader.get()), rowCount, KI, getIntCol);
-            }
+            if(logical->is_date())
+                return numeric<parquet::Int32Type, I, 1, 10957>(KD, list);
+            if(logical->is_time())
+                return numeric<parquet::Int32Type, I, 1, 0>(KT, list);
+            if(logical->is_compatible(parquet::ConvertedType::INT_16))
+                return list ? Decoder{getListCol<parquet::Int32Type, H, 1, 0>, KH, 1, 0}
+                            : Decoder{typed<parquet::Int32Reader, getShortCol>, KH, 1, 0};
+            return numeric<parquet::Int32Type, I, 1, 0>(KI, list);
         case Type::INT64:
-            switch(column_reader->descr()->logical_type()->type()){
-                case parquet::LogicalType::Type::TIMESTAMP:
-                    if(column_reader->descr()->logical_type()->ToString().find("timeUnit=nanoseconds") != std::string::npos)
-                        return getCol(static_cast<parquet::Int64Reader*>(column_reader.get()), rowCount, KP, getTimestampCol);
-                case parquet::LogicalType::Type::TIME:
-                    if(column_reader->descr()->logical_type()->ToString().find("timeUnit=nanoseconds") != std::string::npos)
-                        return getCol(static_cast<parquet::Int64Reader*>(column_reader.get()), rowCount, KN, getLongCol);
-                default:
-                    return getCol(static_cast<parquet::Int64Reader*>(column_reader.get()), rowCount, KJ, getLongCol);
+            //Milli and microsecond timestamps and times are brought up to q's nanoseconds
+            if(logical->is_timestamp()){
+                switch(static_cast<const parquet::TimestampLogicalType&>(*logical).time_unit()){
+                    case LogicalType::TimeUnit::MILLIS:
+                        return numeric<parquet::Int64Type, J64, 1000000, 946684800000000000>(KP, list);
+                    case LogicalType::TimeUnit::MICROS:
+                        return numeric<parquet::Int64Type, J64, 1000, 946684800000000000>(KP, list);
+                    case LogicalType::TimeUnit::NANOS:
+                        return numeric<parquet::Int64Type, J64, 1, 946684800000000000>(KP, list);
+                    default:
+                        break;
+                }
             }
-        case Type::INT96:
-            return getCol(static_cast<parquet::Int96Reader*>(column_reader.get()), rowCount, KP, getInt96Col);
+            if(logical->is_time()){
+                switch(static_cast<const parquet::TimeLogicalType&>(*logical).time_unit()){
+                    case LogicalType::TimeUnit::MICROS:
+                        return numeric<parquet::Int64Type, J64, 1000, 0>(KN, list);
+                    case LogicalType::TimeUnit::NANOS:
+                        return numeric<parquet::Int64Type, J64, 1, 0>(KN, list);
+                    default:
+                        break;
+                }
+            }
+            return numeric<parquet::Int64Type, J64, 1, 0>(KJ, list);
         case Type::FLOAT:
-            return getCol(static_cast<parquet::FloatReader*>(column_reader.get()), rowCount, KE, getFloatCol);
+            return numeric<parquet::FloatType, E, 1, 0>(KE, list);
         case Type::DOUBLE:
-            return getCol(static_cast<parquet::DoubleReader*>(column_reader.get()), rowCount, KF, getDoubleCol);
+            return numeric<parquet::DoubleType, F, 1, 0>(KF, list);
+        default:
+            break;
+    }
+    if(list)
+        return {unsupported, 0, 1, 0};
+    switch(descr->physical_type()){
+        case Type::INT96:
+            return {typed<parquet::Int96Reader, getInt96Col>, KP, 1, 0};
         case Type::BYTE_ARRAY:
-            switch(column_reader->descr()->logical_type()->type()){
-                case parquet::LogicalType::Type::STRING:
-                    return getCol(static_cast<parquet::ByteArrayReader*>(column_reader.get()), rowCount, 0, getStringCol);
-                case parquet::LogicalType::Type::ENUM:
-                    return getCol(static_cast<parquet::ByteArrayReader*>(column_reader.get()), rowCount, 0, getSymCol);
-                default:
-                    return getCol(static_cast<parquet::ByteArrayReader*>(column_reader.get()), rowCount, 0, getByteCol);
-            }
+            if(logical->is_string())
+                return {typed<parquet::ByteArrayReader, getStringCol>, 0, 1, 0};
+            if(logical->is_enum())
+                return {typed<parquet::ByteArrayReader, getSymCol>, KS, 1, 0};
+            return {typed<parquet::ByteArrayReader, getByteCol>, 0, 1, 0};
         case Type::FIXED_LEN_BYTE_ARRAY:
-            switch(column_reader->descr()->logical_type()->type()){
-                #if KXVER>=3
-                case parquet::LogicalType::Type::UUID:
-                    return getCol(static_cast<parquet::FixedLenByteArrayReader*>(column_reader.get()), rowCount, UU, getUUIDCol);
-                #endif
-                default:
-                    return getCol(static_cast<parquet::FixedLenByteArrayReader*>(column_reader.get()), rowCount, 0, getFLBACol);
-            }
-        default:return nullptr;
+            #if KXVER>=3
+            if(logical->is_UUID())
+                return {typed<parquet::FixedLenByteArrayReader, getUUIDCol>, UU, 1, 0};
+            #endif
+            return {typed<parquet::FixedLenByteArrayReader, getFLBACol>, descr->type_length() == 1 ? KG : 0, 1, 0};
+        default:
+            return {unsupported, 0, 1, 0};
     }
 }
 
-template<typename T, typename F>
-K PREADER::getCol(T *reader, int rowCount, int kType, F func){
-    return func(reader, kType, rowCount);
+template<typename DType, typename V, int64_t Scale, int64_t Shift>
+PREADER::Decoder PREADER::numeric(int kType, bool list){
+    return {list ? getListCol<DType, V, Scale, Shift> : getCol<DType, V, Scale, Shift>, kType, Scale, Shift};
 }
 
-K PREADER::getBoolCol(parquet::BoolReader *reader, int kType, int rowCount){
-    K res = ktn(kType, rowCount);
-    int16_t definition_level;
-    int16_t repetition_level;
-    int64_t values_read;
-    int rows_read=0;
-    while(reader->HasNext())
-        rows_read += reader->ReadBatch(rowCount, &definition_level, &repetition_level,
-                                             &kB(res)[rows_read], &values_read);
+K PREADER::readColumns(std::shared_ptr<parquet::ColumnReader> column_reader, int rowCount){
+    return readColumns(decoder(column_reader->descr()), column_reader, rowCount);
+}
+
+K PREADER::readColumns(const Decoder& decoder, std::shared_ptr<parquet::ColumnReader> column_reader, int rowCount){
+    STATS_COLUMN("read", columnName(column_reader->descr()));
+    K res = decoder.read(column_reader.get(), decoder.kType, rowCount);
+    if(res){
+        STATS_TYPE(res->t);
+        STATS_ADD(rows, res->n);
+        STATS_ADD(kObjects, 1 + (res->t ? 0 : res->n));
+    }
     return res;
 }
 
-K PREADER::getIntCol(parquet::Int32Reader *reader, int kType, int rowCount){
-    K res = ktn(kType, rowCount);
-    int16_t definition_level;
-    int16_t repetition_level;
+K PREADER::unsupported(parquet::ColumnReader *column_reader, int /*kType*/, int /*rowCount*/){
+    const parquet::ColumnDescriptor* descr = column_reader->descr();
+    throw std::runtime_error("Can't read the column " + columnName(descr) +
+                             (descr->max_repetition_level() > 1 ? ", lists of lists aren't supported" :
+                              " of type " + parquet::TypeToString(descr->physical_type())));
+}
+
+template<typename V>
+V PREADER::null(){
+    if constexpr(std::is_floating_point_v<V>)
+        return static_cast<V>(nf);
+    else if constexpr(sizeof(V) == 8)
+        return static_cast<V>(nj);
+    else if constexpr(sizeof(V) == 4)
+        return ni;
+    else if constexpr(sizeof(V) == 2)
+        return static_cast<V>(nh);
+    else
+        return 0;
+}
+
+template<typename V, int64_t Scale, int64_t Shift, typename T>
+V PREADER::convert(T value){
+    if constexpr(Scale == 1 && Shift == 0)
+        return static_cast<V>(value);
+    else
+        //q nulls written as values in REQUIRED columns stay null
+        return static_cast<V>(value) == null<V>() ? null<V>() : static_cast<V>(value * Scale - Shift);
+}
+
+template<typename R, K (*Get)(R*, int, int)>
+K PREADER::typed(parquet::ColumnReader *column_reader, int kType, int rowCount){
+    return Get(static_cast<R*>(column_reader), kType, rowCount);
+}
+
+template<typename T, typename V>
+void PREADER::readBatch(T *reader, V *values, int rowCount, V null){
+    //Optional columns read packed values, which are spread out over the nulls afterwards
+    bool optional = reader->descr()->max_definition_level() > 0;
+    std::vector<int16_t> definition_levels(optional ? rowCount : 0);
+    int64_t levels_read=0;
+    int64_t total_values=0;
     int64_t values_read;
-    int rows_read=0;
-    while(reader->HasNext())
-        rows_read += reader->ReadBatch(rowCount, &definition_level, &repetition_level, 
-                                             &kI(res)[rows_read], &values_read);
+    while(reader->HasNext() && levels_read < rowCount){
+        STATS_TIMER(decode);
+        levels_read += reader->ReadBatch(rowCount - levels_read,
+                                         optional ? &definition_levels[levels_read] : nullptr, nullptr,
+                                         values + total_values, &values_read);
+        total_values += values_read;
+    }
+    STATS_TIMER(convert);
+    if(optional)
+        for(int64_t i=levels_read-1; i>=0; i--)
+            values[i] = definition_levels[i] ? values[--total_values] : null;
+}
+
+template<typename DType, typename V, int64_t Scale, int64_t Shift>
+K PREADER::getCol(parquet::ColumnReader *column_reader, int kType, int rowCount){
+    using T = typename DType::c_type;
+    static_assert(sizeof(T) == sizeof(V), "Values are decoded in place");
+    K res = ktn(kType, rowCount);
+    T* values = reinterpret_cast<T*>(kG(res));
+    readBatch(static_cast<parquet::TypedColumnReader<DType>*>(column_reader), values, rowCount, null<T>());
+    if constexpr(Scale != 1 || Shift != 0){
+        STATS_TIMER(convert);
+        std::for_each(values, values + rowCount, [](T &n){ n = convert<T, Scale, Shift>(n); });
+    }
     return res;
 }
 
-K PREADER::getDateCol(parquet::Int32Reader *reader, int kType, int rowCount){
-    K res = getIntCol(reader, kType, rowCount);
-    std::for_each(&kI(res)[0], &kI(res)[0] + rowCount, [](int &n){ n-=10957; });
+template<typename DType, typename V, int64_t Scale, int64_t Shift>
+K PREADER::getListCol(parquet::ColumnReader *column_reader, int kType, int rowCount){
+    using T = typename DType::c_type;
+    auto reader = static_cast<parquet::TypedColumnReader<DType>*>(column_reader);
+    const parquet::ColumnDescriptor* descr = reader->descr();
+    int16_t maxDef = descr->max_definition_level();
+    //Levels from here up have an element, a null one is a level short of the max when elements are optional
+    int16_t itemDef = maxDef - (descr->schema_node()->is_optional() ? 1 : 0);
+    std::vector<int16_t> defLevels;
+    std::vector<int16_t> repLevels;
+    std::vector<std::conditional_t<std::is_same_v<T, bool>, uint8_t, T>> values;
+    int64_t levels = 0;
+    int64_t total = 0;
+    {
+        STATS_TIMER(decode);
+        while(reader->HasNext()){
+            defLevels.resize(levels + listBatch);
+            repLevels.resize(levels + listBatch);
+            values.resize(total + listBatch);
+            int64_t read;
+            levels += reader->ReadBatch(listBatch, &defLevels[levels], &repLevels[levels],
+                                        reinterpret_cast<T*>(&values[total]), &read);
+            total += read;
+        }
+    }
+    STATS_TIMER(convert);
+    //Rows start at a repetition level of 0, null and empty lists both come back empty
+    std::vector<J> counts(rowCount, 0);
+    J row = -1;
+    for(int64_t i=0;i<levels;i++){
+        row += repLevels[i] == 0;
+        if(row >= rowCount)
+            throw std::runtime_error("List column has more rows than its row group: " + columnName(descr));
+        counts[row] += defLevels[i] >= itemDef;
+    }
+    K res = ktn(0, rowCount);
+    for(J i=0;i<rowCount;i++)
+        kK(res)[i] = ktn(kType, counts[i]);
+    const T* packed = reinterpret_cast<const T*>(values.data());
+    V* out = nullptr;
+    row = -1;
+    for(int64_t i=0, value=0;i<levels;i++){
+        if(repLevels[i] == 0)
+            out = reinterpret_cast<V*>(kG(kK(res)[++row]));
+        if(defLevels[i] >= itemDef)
+            *out++ = defLevels[i] == maxDef ? convert<V, Scale, Shift>(packed[value++]) : null<V>();
+    }
     return res;
 }
 
 K PREADER::getShortCol(parquet::Int32Reader *reader, int kType, int rowCount){
     K res = ktn(KH, rowCount);
-    std::copy_n(extractShorts(reader, rowCount).begin(), rowCount, &kH(res)[0]);
+    std::vector<int32_t> values = extractShorts(reader, rowCount);
+    STATS_TIMER(convert);
+    std::copy_n(values.begin(), rowCount, &kH(res)[0]);
     return res;
 }
 
 std::vector<int32_t> PREADER::extractShorts(parquet::Int32Reader *reader, int rowCount){
     std::vector<int32_t> value(rowCount);
-    int16_t definition_level;
-    int16_t repetition_level;
-    int64_t values_read;
-    int rows_read=0;
-    while(reader->HasNext())
-        rows_read += reader->ReadBatch(rowCount, &definition_level, &repetition_level, 
-                                             &value[0] + rows_read, &values_read);
+    readBatch(reader, value.data(), rowCount, static_cast<int32_t>(static_cast<H>(nh)));
     return value;
 }
 
-K PREADER::getLongCol(parquet::Int64Reader *reader, int kType, int rowCount){
-    K res = ktn(kType, rowCount);
-    int16_t definition_level;
-    int16_t repetition_level;
-    int64_t values_read;
-    int rows_read=0;
-    while(reader->HasNext())
-        rows_read += reader->ReadBatch(rowCount, &definition_level, &repetition_level,
-                                             &kJ64(res)[rows_read], &values_read);
-    return res;
-}
-
-K PREADER::getTimestampCol(parquet::Int64Reader *reader, int kType, int rowCount){
-    K res = getLongCol(reader, kType, rowCount);
-    std::for_each(&kJ64(res)[0], &kJ64(res)[0] + rowCount, [](int64_t &n){ n-=946684800000000000; });
-    return res;
-}
-
 K PREADER::getInt96Col(parquet::Int96Reader *reader, int kType, int rowCount){
     //magic number convert julian date to unix epoch
     int64_t unixTime=946684800000000000;
@@ -157,47 +342,25 @@ K PREADER::getInt96Col(parquet::Int96Reader *reader, int kType, int rowCount){
     int16_t definition_level;
     int16_t repetition_level;
     int64_t values_read;
+    STATS_TIMER(decode);
     for(int i=0;i<rowCount;i++){
         reader->ReadBatch(1, &definition_level, &repetition_level, &value, &values_read);
-        kJ(res)[i]=parquet::Int96GetNanoSeconds(value)-unixTime;
+        kJ(res)[i]=values_read ? parquet::Int96GetNanoSeconds(value)-unixTime : nj;
     }
     return res;
 }
 
-K PREADER::getFloatCol(parquet::FloatReader *reader, int kType, int rowCount){
-    K res = ktn(kType, rowCount);
-    int16_t definition_level;
-    int16_t repetition_level;
-    int64_t values_read;
-    int rows_read=0;
-    while(reader->HasNext())
-        rows_read += reader->ReadBatch(rowCount, &definition_level, &repetition_level, 
-                                             &kE(res)[rows_read], &values_read);
-    return res;
-}
-
-K PREADER::getDoubleCol(parquet::DoubleReader *reader, int kType, int rowCount){
-    K res = ktn(kType,rowCount);
-    int16_t definition_level;
-    int16_t repetition_level;
-    int64_t values_read;
-    int rows_read=0;
-    while(reader->HasNext())
-        rows_read += reader->ReadBatch(rowCount, &definition_level, &repetition_level, 
-                                             &kF(res)[rows_read], &values_read);
-    return res;
-}
-
 K PREADER::getByteCol(parquet::ByteArrayReader *reader, int kType, int rowCount){
     K res = ktn(kType, 0);
     parquet::ByteArray value;
     int16_t definition_level;
     int16_t repetition_level;
     int64_t values_read;
+    STATS_TIMER(decode);
     for(int i=0;i<rowCount;i++){
         reader->ReadBatch(1, &definition_level, &repetition_level, &value, &values_read);
-        K bytes = ktn(KG, value.len); 
-        std::copy(&value.ptr[0], &value.ptr[0]+value.len, kG(bytes));
+        K bytes = ktn(KG, values_read ? value.len : 0); 
+        std::copy(&value.ptr[0], &value.ptr[0]+bytes->n, kG(bytes));
         jk(&res,bytes);
     }
     return res;
@@ -209,9 +372,10 @@ K PREADER::getStringCol(parquet::ByteArrayReader *reader, int kType, int rowCoun
     int16_t definition_level;
     int16_t repetition_level;
     int64_t values_read;
+    STATS_TIMER(decode);
     for(int i=0;i<rowCount;i++){
         reader->ReadBatch(1, &definition_level, &repetition_level, &value, &values_read);
-        jk(&res,kpn((char*)&value.ptr[0], value.len));
+        jk(&res,values_read ? kpn((char*)&value.ptr[0], value.len) : ktn(KC,0));
     }
     return res;
 }
@@ -222,9 +386,10 @@ K PREADER::getSymCol(parquet::ByteArrayReader *reader, int kType, int rowCount){
     int16_t definition_level;
     int16_t repetition_level;
     int64_t values_read;
+    STATS_TIMER(decode);
     for(int i=0;i<rowCount;i++){
         reader->ReadBatch(1, &definition_level, &repetition_level, &value, &values_read);
-        kS(res)[i]=sn((char*)&value.ptr[0], value.len);
+        kS(res)[i]=values_read ? sn((char*)&value.ptr[0], value.len) : ss((char*)"");
     }
     return res;
 }
@@ -236,16 +401,17 @@ K PREADER::getFLBACol(parquet::FixedLenByteArrayReader *reader, int kType, int r
     int16_t definition_level;
     int16_t repetition_level;
     int64_t values_read;
+    STATS_TIMER(decode);
     if(size ==1){
         for(int i=0;i<rowCount;i++){
             reader->ReadBatch(1, &definition_level, &repetition_level, &value, &values_read);
-            kG(res)[i]=*value.ptr;
+            kG(res)[i]=values_read ? *value.ptr : 0;
         }
     } else {
         for(int i=0;i<rowCount;i++){
             reader->ReadBatch(1, &definition_level, &repetition_level, &value, &values_read);
-            K bytes = ktn(KG, size); 
-            std::copy(&value.ptr[0], &value.ptr[0]+size, kG(bytes));
+            K bytes = ktn(KG, values_read ? size : 0); 
+            std::copy(&value.ptr[0], &value.ptr[0]+bytes->n, kG(bytes));
             jk(&res,bytes); 
         }           
     }
@@ -259,9 +425,13 @@ K PREADER::getUUIDCol(parquet::FixedLenByteArrayReader *reader, int kType, int r
     int16_t definition_level;
     int16_t repetition_level;
     int64_t values_read;
+    STATS_TIMER(decode);
     for(int i=0;i<rowCount;i++){
         reader->ReadBatch(1, &definition_level, &repetition_level, &value, &values_read);
-        std::copy(&value.ptr[0], &value.ptr[0]+16, kU(res)[i].g);
+        if(values_read)
+            std::copy(&value.ptr[0], &value.ptr[0]+16, kU(res)[i].g);
+        else
+            std::fill(kU(res)[i].g, kU(res)[i].g+16, 0);
     }
     return res;
 }
@@ -0,0 +1,233 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <sample.hpp>
+#include <algorithm>
+
+using namespace KDB::PARQ;
+
+namespace{
+    //Rows of a flat column are its levels, so skipping levels skips rows
+    void skip(parquet::ColumnReader* column, int64_t rows){
+        if(rows <= 0)
+            return;
+        int64_t skipped;
+        switch(column->type()){
+            case Type::BOOLEAN:
+                skipped = static_cast<parquet::BoolReader*>(column)->Skip(rows);
+                break;
+            case Type::INT32:
+                skipped = static_cast<parquet::Int32Reader*>(column)->Skip(rows);
+                break;
+            case Type::INT64:
+                skipped = static_cast<parquet::Int64Reader*>(column)->Skip(rows);
+                break;
+            case Type::INT96:
+                skipped = static_cast<parquet::Int96Reader*>(column)->Skip(rows);
+                break;
+            case Type::FLOAT:
+                skipped = static_cast<parquet::FloatReader*>(column)->Skip(rows);
+                break;
+            case Type::DOUBLE:
+                skipped = static_cast<parquet::DoubleReader*>(column)->Skip(rows);
+                break;
+            case Type::BYTE_ARRAY:
+                skipped = static_cast<parquet::ByteArrayReader*>(column)->Skip(rows);
+                break;
+            case Type::FIXED_LEN_BYTE_ARRAY:
+                skipped = static_cast<parquet::FixedLenByteArrayReader*>(column)->Skip(rows);
+                break;
+            default:
+                throw std::runtime_error("Can't sample the column " + PREADER::columnName(column->descr()));
+        }
+        if(skipped != rows)
+            throw std::runtime_error("Column " + PREADER::columnName(column->descr()) + " ended before its row group");
+    }
+}
+
+K SAMPLE::run(const std::string& file, K cols, double fraction, J seed, K props){
+    STATS_SPAN("sample");
+    std::shared_ptr<parquet::ParquetFileReader> reader = PREADER::open_reader(file, props);
+    std::shared_ptr<parquet::FileMetaData> metadata = reader->metadata();
+    std::vector<int> indices = columns(metadata->schema(), cols);
+    std::shared_ptr<const PREADER::Plan> plan = PREADER::plan(metadata->schema());
+
+    //Pages are picked before anything is read, so only their row groups are pre-buffered
+    std::mt19937_64 random(seed);
+    int groups = metadata->num_row_groups();
+    std::vector<std::vector<Range>> picked(groups);
+    std::vector<int> reads;
+    for(int i=0;i<groups;i++){
+        picked[i] = pick(reader, i, indices, fraction, random);
+        if(!picked[i].empty())
+            reads.push_back(i);
+    }
+    PREADER::preBuffer(reader, reads, indices, props);
+
+    K rows = ktn(KJ, 0);
+    K values = ktn(0, indices.size());
+    K names = ktn(KS, indices.size());
+    for(size_t c=0;c<indices.size();c++){
+        kK(values)[c] = ktn((*plan)[indices[c]].kType, 0);
+        kS(names)[c] = ss(const_cast<S>(PREADER::columnName(metadata->schema()->Column(indices[c])).c_str()));
+    }
+    try{
+        int64_t offset = 0;
+        for(int i=0;i<groups;i++){
+            if(!picked[i].empty()){
+                std::shared_ptr<parquet::RowGroupReader> rowGroup = reader->RowGroup(i);
+                for(const Range& range : picked[i])
+                    for(J r=offset+range.first;r<offset+range.first+range.rows;r++)
+                        ja(&rows, &r);
+                for(size_t c=0;c<indices.size();c++){
+                    K piece = read(rowGroup, indices[c], (*plan)[indices[c]], picked[i]);
+                    jv(&kK(values)[c], piece);
+                    r0(piece);
+                }
+            }
+            offset += metadata->RowGroup(i)->num_rows();
+        }
+    }catch(...){
+        r0(rows);
+        r0(values);
+        r0(names);
+        throw;
+    }
+    //Keyed by the row each sampled row has in the file
+    K key = ktn(KS, 1);
+    kS(key)[0] = ss(const_cast<S>("row"));
+    return xD(xT(xD(key, knk(1, rows))), xT(xD(names, values)));
+}
+
+std::vector<int> SAMPLE::columns(const parquet::SchemaDescriptor* schema, K cols){
+    std::vector<int> indices;
+    if(cols->t != KS || !cols->n)
+        for(int i=0;i<schema->num_columns();i++)
+            indices.push_back(i);
+    else
+        for(J i=0;i<cols->n;i++){
+            int index = PREADER::columnIndex(schema, kS(cols)[i]);
+            if(index < 0)
+                throw std::runtime_error(std::string{"Column not in file: "} + kS(cols)[i]);
+            indices.push_back(index);
+        }
+    if(indices.empty())
+        throw std::runtime_error("File has no columns to sample");
+    for(int index : indices)
+        if(schema->Column(index)->max_repetition_level())
+            throw std::runtime_error("Can't sample the list column " + PREADER::columnName(schema->Column(index)));
+    return indices;
+}
+
+std::vector<SAMPLE::Range> SAMPLE::pick(std::shared_ptr<parquet::ParquetFileReader> reader, int rowGroup,
+                                        const std::vector<int>& columns, double fraction, std::mt19937_64& random){
+    //Every page takes a draw, so the same seed picks the same pages of the same file
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<Range> ranges;
+    int64_t first = 0;
+    for(int64_t rows : pageRows(reader, rowGroup, columns)){
+        if(uniform(random) < fraction){
+            if(!ranges.empty() && ranges.back().first + ranges.back().rows == first)
+                ranges.back().rows += rows;
+            else
+                ranges.push_back({first, rows});
+        }
+        first += rows;
+    }
+    return ranges;
+}
+
+std::vector<int64_t> SAMPLE::pageRows(std::shared_ptr<parquet::ParquetFileReader> reader, int rowGroup,
+                                     const std::vector<int>& columns){
+    std::vector<int64_t> rows;
+    //The offset index has where every page starts without touching the column chunks,
+    //so the column cut into the most pages gives the finest sample
+    std::shared_ptr<parquet::PageIndexReader> pageIndex = reader->GetPageIndexReader();
+    std::shared_ptr<parquet::RowGroupPageIndexReader> group = pageIndex ? pageIndex->RowGroup(rowGroup) : nullptr;
+    int64_t total = reader->metadata()->RowGroup(rowGroup)->num_rows();
+    for(int column : columns){
+        std::shared_ptr<parquet::OffsetIndex> offsets = group ? group->GetOffsetIndex(column) : nullptr;
+        if(!offsets || offsets->page_locations().size() <= rows.size())
+            continue;
+        const std::vector<parquet::PageLocation>& pages = offsets->page_locations();
+        rows.clear();
+        for(size_t i=0;i<pages.size();i++)
+            rows.push_back((i + 1 < pages.size() ? pages[i + 1].first_row_index : total) - pages[i].first_row_index);
+    }
+    if(!rows.empty())
+        return rows;
+    //Otherwise the page headers of the first column are walked, with every data page filtered out before
+    //it's decompressed
+    std::unique_ptr<parquet::PageReader> pager = reader->RowGroup(rowGroup)->GetColumnPageReader(columns[0]);
+    pager->set_data_page_filter([&rows](const parquet::DataPageStats& stats){
+        rows.push_back(stats.num_rows.value_or(stats.num_values));
+        return true;
+    });
+    while(pager->NextPage());
+    return rows;
+}
+
+K SAMPLE::read(std::shared_ptr<parquet::RowGroupReader> rowGroup, int index, const PREADER::Decoder& decoder,
+               const std::vector<Range>& ranges){
+    //Pages without a picked row are dropped before they're decompressed, the reader only sees the rest.
+    //first and end are the rows of the latest page it has loaded
+    int64_t start = 0, first = 0, end = 0;
+    std::unique_ptr<parquet::PageReader> pager = rowGroup->GetColumnPageReader(index);
+    pager->set_data_page_filter([&](const parquet::DataPageStats& stats){
+        int64_t rows = stats.num_rows.value_or(stats.num_values);
+        auto next = std::partition_point(ranges.begin(), ranges.end(),
+                                         [start](const Range& range){ return range.first + range.rows <= start; });
+        bool keep = next != ranges.end() && next->first < start + rows;
+        if(keep){
+            first = start;
+            end = start + rows;
+        }
+        start += rows;
+        return !keep;
+    });
+    #ifdef PARQ_STATS
+    pager = STATS::pages(std::move(pager));
+    #endif
+    std::shared_ptr<parquet::ColumnReader> column =
+        parquet::ColumnReader::Make(rowGroup->metadata()->schema()->Column(index), std::move(pager),
+                                    &POOL::getInstance());
+
+    K res = ktn(decoder.kType, 0);
+    try{
+        int64_t position = 0;
+        for(const Range& range : ranges){
+            //Reading up to the end of a page can load the next one, the rows dropped in between aren't there to skip
+            position = std::max(position, first);
+            //Past the loaded page, its last rows are skipped and the next kept page is the one holding the range
+            if(range.first >= end){
+                skip(column.get(), end - position);
+                if(!column->HasNext())
+                    throw std::runtime_error("Column " + PREADER::columnName(column->descr()) +
+                                             " ended before its row group");
+                position = first;
+            }
+            skip(column.get(), range.first - position);
+            K piece = PREADER::readColumns(decoder, column, range.rows);
+            jv(&res, piece);
+            r0(piece);
+            position = range.first + range.rows;
+        }
+    }catch(...){
+        r0(res);
+        throw;
+    }
+    return res;
+}
@@ -0,0 +1,167 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <sorter.hpp>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <thread>
+
+using namespace KDB::PARQ;
+
+K SORTER::sortIndex(K table, K cols){
+    K colValues = kK(table->k)[1];
+    J len = colValues->n ? kK(colValues)[0]->n : 0;
+
+    std::vector<Key> keys = sortKeys(table, cols);
+    K res = ktn(KJ, len);
+    std::iota(kJ(res), kJ(res) + len, 0);
+    parallelSort(kJ(res), len, keys);
+    releaseKeys(keys);
+    return res;
+}
+
+std::vector<SORTER::Key> SORTER::sortKeys(K table, K cols){
+    K colNames = kK(table->k)[0];
+    K colValues = kK(table->k)[1];
+
+    std::vector<Key> keys;
+    for(int i=0;i<cols->n;i++){
+        S* name = std::find(kS(colNames), kS(colNames) + colNames->n, kS(cols)[i]);
+        if(name == kS(colNames) + colNames->n){
+            releaseKeys(keys);
+            throw std::runtime_error(std::string{"Sort column not in table: "} + kS(cols)[i]);
+        }
+        K col = kK(colValues)[name - kS(colNames)];
+        if(!sortable(col)){
+            releaseKeys(keys);
+            throw std::runtime_error(std::string{"Unsupported sort column type: "} + kS(cols)[i]);
+        }
+        //Enumerations compare by sym, so their domains are resolved up front on the main thread
+        keys.push_back(Key{col, 20 <= col->t && col->t <= 76 ? WRITER::enumDomain(col) : nullptr});
+        if(keys.back().domain && std::any_of(kJ(col), kJ(col) + col->n,
+                                             [&keys](J n){ return n < 0 || n >= keys.back().domain->n; })){
+            releaseKeys(keys);
+            throw std::runtime_error("Enumeration index out of range of its domain");
+        }
+    }
+    return keys;
+}
+
+void SORTER::releaseKeys(std::vector<Key>& keys){
+    for(auto& key : keys)
+        if(key.domain) r0(key.domain);
+    keys.clear();
+}
+
+void SORTER::parallelSort(J* index, J len, const std::vector<Key>& keys){
+    //Stable sort each chunk on its own thread, then merge neighbouring chunks in parallel
+    J minChunk = 65536;
+    int threads = std::max<J>(1, std::min<J>(THREADS::workers(), len / minChunk));
+    std::vector<J> bounds;
+    for(int i=0;i<=threads;i++)
+        bounds.push_back(len * i / threads);
+
+    auto less = [&keys](J a, J b){ return lessThan(keys, a, b); };
+    std::vector<std::thread> workers;
+    for(int i=0;i<threads;i++)
+        workers.emplace_back([&, i](){
+            THREADS::pin();
+            THREADS::Busy busy;
+            std::stable_sort(index + bounds[i], index + bounds[i+1], less);
+        });
+    for(auto& worker : workers)
+        worker.join();
+
+    for(int width=1; width<threads; width*=2){
+        workers.clear();
+        for(int i=0; i+width<threads; i+=2*width){
+            J* first = index + bounds[i];
+            J* middle = index + bounds[i+width];
+            J* last = index + bounds[std::min(i+2*width, threads)];
+            workers.emplace_back([=](){
+                THREADS::pin();
+                THREADS::Busy busy;
+                std::inplace_merge(first, middle, last, less);
+            });
+        }
+        for(auto& worker : workers)
+            worker.join();
+    }
+}
+
+bool SORTER::lessThan(const std::vector<Key>& keys, J a, J b){
+    for(auto& key : keys){
+        int res = compare(key, a, b);
+        if(res) return res < 0;
+    }
+    return false;
+}
+
+template<typename T>
+static int compareValues(T a, T b){
+    return a < b ? -1 : b < a;
+}
+
+template<typename T>
+static int compareFloats(T a, T b){
+    //Nulls sort first as they do in q
+    if(std::isnan(a) || std::isnan(b))
+        return std::isnan(b) - std::isnan(a);
+    return compareValues(a, b);
+}
+
+static int compareBytes(const G* a, J lenA, const G* b, J lenB){
+    int res = std::memcmp(a, b, std::min(lenA, lenB));
+    return res ? res : compareValues(lenA, lenB);
+}
+
+int SORTER::compare(const Key& key, J a, J b){
+    K col = key.col;
+    switch(col->t){
+        case KB: case KG: case KC:
+            return compareValues(kG(col)[a], kG(col)[b]);
+        case KH:
+            return compareValues(kH(col)[a], kH(col)[b]);
+        case KI: case KM: case KD: case KU: case KV: case KT:
+            return compareValues(kI(col)[a], kI(col)[b]);
+        case KJ: case KP: case KN:
+            return compareValues(kJ(col)[a], kJ(col)[b]);
+        case KE:
+            return compareFloats(kE(col)[a], kE(col)[b]);
+        case KF: case KZ:
+            return compareFloats(kF(col)[a], kF(col)[b]);
+        case KS:
+            return kS(col)[a] == kS(col)[b] ? 0 : std::strcmp(kS(col)[a], kS(col)[b]);
+        #if KXVER>=3
+        case UU:
+            return std::memcmp(kU(col)[a].g, kU(col)[b].g, 16);
+        #endif
+        case 0:
+            return compareBytes(kG(kK(col)[a]), kK(col)[a]->n, kG(kK(col)[b]), kK(col)[b]->n);
+        default:{
+            S symA = kS(key.domain)[kJ(col)[a]];
+            S symB = kS(key.domain)[kJ(col)[b]];
+            return symA == symB ? 0 : std::strcmp(symA, symB);
+        }
+    }
+}
+
+bool SORTER::sortable(K col){
+    if(col->t == 0)
+        return std::all_of(kK(col), kK(col) + col->n, [](K item){ return item->t == KC || item->t == KG; });
+    return (KB <= col->t && col->t <= KT && col->t != 3) || (20 <= col->t && col->t <= 76);
+}
@@ -0,0 +1,412 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stats.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+using namespace KDB::PARQ;
+
+namespace{
+    using Key = std::tuple<std::string, std::string, int>;
+
+    struct Event{
+        std::string name;
+        const char* category;
+        J start;
+        J duration;
+    };
+
+    struct ThreadStats{
+        std::mutex mutex;
+        std::map<Key, STATS::Counters> counters;
+        std::vector<Event> events;
+        J tid;
+    };
+
+    struct Registry{
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadStats>> threads;
+        //Counters and spans of threads that have exited, so short lived workers don't pile up
+        std::map<Key, STATS::Counters> retired;
+        std::vector<std::pair<J, Event>> retiredEvents;
+        J nextTid = 1;
+        std::atomic<bool> tracing {false};
+    };
+
+    //Spans past this many per thread, or in all, of exited threads are dropped,
+    //so tracing left on can't grow without bound
+    constexpr size_t maxEvents = 1 << 20;
+
+    //Never destroyed, threads can still be finishing work while the process exits
+    Registry& registry(){
+        static Registry* instance = new Registry;
+        return *instance;
+    }
+
+    //What the current thread is attributing work to
+    struct State{
+        std::shared_ptr<ThreadStats> thread;
+        bool active = false;
+        STATS::Counters column;
+        int type = 0;
+        J nested = 0;
+
+        //Folds the thread's counters into the retired ones as it exits
+        ~State(){
+            if(!thread)
+                return;
+            Registry& reg = registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            {
+                std::lock_guard<std::mutex> threadLock(thread->mutex);
+                for(auto& entry : thread->counters)
+                    reg.retired[entry.first].add(entry.second);
+                for(auto& event : thread->events){
+                    if(reg.retiredEvents.size() >= maxEvents)
+                        break;
+                    reg.retiredEvents.emplace_back(thread->tid, std::move(event));
+                }
+            }
+            reg.threads.erase(std::remove(reg.threads.begin(), reg.threads.end(), thread), reg.threads.end());
+        }
+    };
+    thread_local State state;
+
+    ThreadStats& thread(){
+        if(!state.thread){
+            state.thread = std::make_shared<ThreadStats>();
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            state.thread->tid = registry().nextTid++;
+            registry().threads.push_back(state.thread);
+        }
+        return *state.thread;
+    }
+
+    J now(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(std::string name, const char* category, J start){
+        ThreadStats& stats = thread();
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        if(stats.events.size() < maxEvents)
+            stats.events.push_back({std::move(name), category, start, now() - start});
+    }
+
+    J STATS::Counters::* field(STATS::Stage stage){
+        switch(stage){
+            case STATS::io: return &STATS::Counters::ioNs;
+            case STATS::decompress: return &STATS::Counters::decompressNs;
+            case STATS::decode: return &STATS::Counters::decodeNs;
+            case STATS::encode: return &STATS::Counters::encodeNs;
+            default: return &STATS::Counters::convertNs;
+        }
+    }
+
+    char typeChar(int type){
+        //Enumerations show as symbols, as they do in meta
+        return type < 20 ? " bg xhijefcspmdznuvt"[type] : 's';
+    }
+
+    std::string escape(const std::string& s){
+        std::string res;
+        for(char c : s){
+            if(c == '"' || c == '\\')
+                res += '\\';
+            if(static_cast<unsigned char>(c) >= 0x20)
+                res += c;
+        }
+        return res;
+    }
+
+    //Times reads from the file, which happen on the IO pool when pre-buffering
+    class CountingFile : public arrow::io::RandomAccessFile{
+        public:
+            explicit CountingFile(std::shared_ptr<arrow::io::RandomAccessFile> source) : source_(source){}
+
+            arrow::Status Close() override{ return source_->Close(); }
+            bool closed() const override{ return source_->closed(); }
+            arrow::Result<int64_t> Tell() const override{ return source_->Tell(); }
+            arrow::Status Seek(int64_t position) override{ return source_->Seek(position); }
+            arrow::Result<int64_t> GetSize() override{ return source_->GetSize(); }
+
+            arrow::Result<int64_t> Read(int64_t nbytes, void* out) override{
+                STATS::Timer timer {STATS::io};
+                return counted(source_->Read(nbytes, out));
+            }
+
+            arrow::Result<std::shared_ptr<arrow::Buffer>> Read(int64_t nbytes) override{
+                STATS::Timer timer {STATS::io};
+                return counted(source_->Read(nbytes));
+            }
+
+            arrow::Result<int64_t> ReadAt(int64_t position, int64_t nbytes, void* out) override{
+                STATS::Timer timer {STATS::io};
+                return counted(source_->ReadAt(position, nbytes, out));
+            }
+
+            arrow::Result<std::shared_ptr<arrow::Buffer>> ReadAt(int64_t position, int64_t nbytes) override{
+                STATS::Timer timer {STATS::io};
+                return counted(source_->ReadAt(position, nbytes));
+            }
+
+            //Passed on so files that batch the ranges themselves still can, counted as they land
+            std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>> ReadManyAsync(
+                    const arrow::io::IOContext& ctx, const std::vector<arrow::io::ReadRange>& ranges) override{
+                STATS::Timer timer {STATS::io};
+                auto futures = source_->ReadManyAsync(ctx, ranges);
+                for(auto& future : futures)
+                    future = future.Then([](const std::shared_ptr<arrow::Buffer>& buffer){
+                        STATS::add(&STATS::Counters::bytes, buffer->size());
+                        return buffer;
+                    });
+                return futures;
+            }
+
+        private:
+            static arrow::Result<int64_t> counted(arrow::Result<int64_t> res){
+                if(res.ok())
+                    STATS::add(&STATS::Counters::bytes, *res);
+                return res;
+            }
+
+            static arrow::Result<std::shared_ptr<arrow::Buffer>> counted(arrow::Result<std::shared_ptr<arrow::Buffer>> res){
+                if(res.ok())
+                    STATS::add(&STATS::Counters::bytes, (*res)->size());
+                return res;
+            }
+
+            std::shared_ptr<arrow::io::RandomAccessFile> source_;
+    };
+
+    //Pages are decompressed as they're fetched, so this times decompression less the IO under it
+    class CountingPages : public parquet::PageReader{
+        public:
+            explicit CountingPages(std::unique_ptr<parquet::PageReader> pager) : pager_(std::move(pager)){}
+
+            std::shared_ptr<parquet::Page> NextPage() override{
+                STATS::Timer timer {STATS::decompress};
+                std::shared_ptr<parquet::Page> page = pager_->NextPage();
+                if(page)
+                    STATS::add(&STATS::Counters::pages, 1);
+                return page;
+            }
+
+            void set_max_page_header_size(uint32_t size) override{
+                pager_->set_max_page_header_size(size);
+            }
+
+        private:
+            std::unique_ptr<parquet::PageReader> pager_;
+    };
+}
+
+void STATS::Counters::add(const Counters& other){
+    calls += other.calls;
+    rows += other.rows;
+    bytes += other.bytes;
+    pages += other.pages;
+    ioNs += other.ioNs;
+    decompressNs += other.decompressNs;
+    decodeNs += other.decodeNs;
+    encodeNs += other.encodeNs;
+    convertNs += other.convertNs;
+    allocations += other.allocations;
+    allocBytes += other.allocBytes;
+    kObjects += other.kObjects;
+}
+
+STATS::Column::Column(const char* op, const std::string& name)
+        : active(!state.active), op(op), name(name), start(0)
+{
+    if(!active)
+        return;
+    state.active = true;
+    state.column = Counters {};
+    state.column.calls = 1;
+    state.type = 0;
+    start = registry().tracing ? now() : 0;
+}
+
+STATS::Column::~Column(){
+    if(!active)
+        return;
+    state.active = false;
+    ThreadStats& stats = thread();
+    {
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        stats.counters[Key {op, name, state.type}].add(state.column);
+    }
+    if(start)
+        record(std::string {op} + " " + name, "column", start);
+}
+
+STATS::Timer::Timer(Stage stage) : stage(stage), start(now()), outer(state.nested){
+    state.nested = 0;
+}
+
+STATS::Timer::~Timer(){
+    J elapsed = now() - start;
+    add(field(stage), elapsed - state.nested);
+    state.nested = outer + elapsed;
+}
+
+STATS::Span::Span(const char* name) : name(name), start(registry().tracing ? now() : 0){
+}
+
+STATS::Span::~Span(){
+    if(start)
+        record(name, "span", start);
+}
+
+void STATS::add(J Counters::* field, J value){
+    if(state.active){
+        state.column.*field += value;
+        return;
+    }
+    //Work outside any column, such as footer reads and pre-buffering on the IO pool
+    ThreadStats& stats = thread();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    stats.counters[Key {"other", "", 0}].*field += value;
+}
+
+void STATS::setType(int type){
+    if(state.active && !state.type)
+        state.type = type;
+}
+
+bool STATS::enabled(){
+    #ifdef PARQ_STATS
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+K STATS::table(){
+    std::map<Key, Counters> totals;
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        totals = registry().retired;
+        for(auto& stats : registry().threads){
+            std::lock_guard<std::mutex> threadLock(stats->mutex);
+            for(auto& entry : stats->counters)
+                totals[entry.first].add(entry.second);
+        }
+    }
+
+    std::vector<std::pair<const char*, J Counters::*>> fields {
+        {"calls", &Counters::calls}, {"rows", &Counters::rows}, {"bytes", &Counters::bytes},
+        {"pages", &Counters::pages}, {"ioNs", &Counters::ioNs}, {"decompressNs", &Counters::decompressNs},
+        {"decodeNs", &Counters::decodeNs}, {"encodeNs", &Counters::encodeNs}, {"convertNs", &Counters::convertNs},
+        {"allocations", &Counters::allocations}, {"allocBytes", &Counters::allocBytes},
+        {"kObjects", &Counters::kObjects}
+    };
+    K names = ktn(KS, 0);
+    for(auto name : {"op", "column", "type"})
+        js(&names, ss(const_cast<S>(name)));
+    for(auto& f : fields)
+        js(&names, ss(const_cast<S>(f.first)));
+
+    J n = totals.size();
+    K values = ktn(0, 0);
+    jk(&values, ktn(KS, n));
+    jk(&values, ktn(KS, n));
+    jk(&values, ktn(KC, n));
+    for(size_t i=0;i<fields.size();i++)
+        jk(&values, ktn(KJ, n));
+    J row = 0;
+    for(auto& entry : totals){
+        kS(kK(values)[0])[row] = ss(const_cast<S>(std::get<0>(entry.first).c_str()));
+        kS(kK(values)[1])[row] = ss(const_cast<S>(std::get<1>(entry.first).c_str()));
+        kC(kK(values)[2])[row] = typeChar(std::get<2>(entry.first));
+        for(size_t i=0;i<fields.size();i++)
+            kJ(kK(values)[3 + i])[row] = entry.second.*fields[i].second;
+        row++;
+    }
+    return xT(xD(names, values));
+}
+
+void STATS::reset(){
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    registry().retired.clear();
+    registry().retiredEvents.clear();
+    for(auto& stats : registry().threads){
+        std::lock_guard<std::mutex> threadLock(stats->mutex);
+        stats->counters.clear();
+        stats->events.clear();
+    }
+}
+
+void STATS::trace(bool on){
+    if(on && !enabled())
+        throw std::runtime_error("ParQ was built without PARQ_STATS, rebuild with make STATS=1 to trace");
+    registry().tracing = on;
+}
+
+void STATS::dump(const std::string& file){
+    std::ofstream out(file);
+    if(!out)
+        throw std::runtime_error("Unable to open trace file " + file);
+    //Chrome's trace event format, load it in chrome://tracing or Perfetto
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    auto write = [&](const Event& event, J tid){
+        out << (first ? "\n" : ",\n")
+            << "{\"name\":\"" << escape(event.name) << "\",\"cat\":\"" << event.category
+            << "\",\"ph\":\"X\",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0
+            << ",\"pid\":" << getpid() << ",\"tid\":" << tid << "}";
+        first = false;
+    };
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    for(auto& retired : registry().retiredEvents)
+        write(retired.second, retired.first);
+    for(auto& stats : registry().threads){
+        std::lock_guard<std::mutex> threadLock(stats->mutex);
+        for(auto& event : stats->events)
+            write(event, stats->tid);
+    }
+    out << "\n]}\n";
+    if(!out)
+        throw std::runtime_error("Unable to write trace file " + file);
+}
+
+std::shared_ptr<arrow::io::RandomAccessFile> STATS::file(std::shared_ptr<arrow::io::RandomAccessFile> source){
+    #ifdef PARQ_STATS
+    return std::make_shared<CountingFile>(source);
+    #else
+    return source;
+    #endif
+}
+
+std::unique_ptr<parquet::PageReader> STATS::pages(std::unique_ptr<parquet::PageReader> pager){
+    #ifdef PARQ_STATS
+    return std::make_unique<CountingPages>(std::move(pager));
+    #else
+    return pager;
+    #endif
+}
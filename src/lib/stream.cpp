@@ -0,0 +1,445 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stream.hpp>
+#include <cstring>
+
+using namespace KDB::PARQ;
+
+std::map<J, PSTREAM*> PSTREAM::instances;
+J PSTREAM::nextHandle = 0;
+
+PSTREAM::PSTREAM(std::shared_ptr<parquet::ParquetFileWriter> fileWriter,
+                 std::shared_ptr<arrow::io::OutputStream> sink, K table,
+                 J maxRows, J maxBytes, J maxMillis)
+        : fileWriter_(fileWriter), sink_(sink), hasPending(false), stopping(false),
+          maxRows(maxRows), maxBytes(maxBytes), maxMillis(maxMillis),
+          rowsWritten(0), rowGroups(0), waits(0)
+{
+    K colNames = kK(table->k)[0];
+    K colValues = kK(table->k)[1];
+    const parquet::SchemaDescriptor* schema = fileWriter_->schema();
+    for(int i=0;i<colNames->n;i++){
+        names.push_back(kS(colNames)[i]);
+        int type = kK(colValues)[i]->t;
+        //Enumerations are buffered as the syms they resolve to
+        ColumnBuffer column;
+        column.type = 20 <= type && type <= 76 ? KS : type;
+        column.itemType = schema->Column(i)->max_repetition_level() > 0 ? WRITER::listType(kK(colValues)[i]) : 0;
+        column.optional = schema->Column(i)->max_definition_level() > (column.itemType ? 1 : 0);
+        active.columns.push_back(column);
+    }
+    pending.columns = active.columns;
+    clearBuffer(active);
+    clearBuffer(pending);
+    worker = std::thread(&PSTREAM::run, this);
+}
+
+PSTREAM::~PSTREAM(){
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+        cv.notify_all();
+    }
+    if(worker.joinable())
+        worker.join();
+}
+
+void PSTREAM::finish(){
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(active.rows && error.empty())
+            enqueue(lock);
+        stopping = true;
+        cv.notify_all();
+    }
+    worker.join();
+    if(!error.empty())
+        throw std::runtime_error(error);
+    //Only closed once the last row group is down, so the footer covers every row group
+    WRITER::CloseFile(fileWriter_, sink_);
+}
+
+K PSTREAM::open(std::string fileName, K table, parquet::Compression::type codec,
+                K metadata, K props, K limits){
+    try{
+        K colValues = kK(table->k)[1];
+        K colNames = kK(table->k)[0];
+        std::shared_ptr<GroupNode> schema = WRITER::SetupSchema(colNames, colValues, colValues->n,
+                                                                dictBool(props, "nullable", false));
+        std::shared_ptr<arrow::io::OutputStream> sink;
+        std::shared_ptr<parquet::ParquetFileWriter> fileWriter = WRITER::OpenFile(fileName, schema, codec, false,
+                                                                                  metadata, props,
+                                                                                  WRITER::ColumnOptions(props), sink);
+        PSTREAM* stream = new PSTREAM {fileWriter,
+                                       sink,
+                                       table,
+                                       dictLong(limits, "rows", 1048576),
+                                       dictLong(limits, "bytes", 134217728),
+                                       dictLong(limits, "millis", 0)};
+        instances[++nextHandle] = stream;
+        return kj(nextHandle);
+    }catch (const std::exception& e) {
+            char* error = const_cast<char*>(e.what());
+            return orr(error);
+    }
+}
+
+PSTREAM* PSTREAM::getInstance(J handle){
+    auto it = instances.find(handle);
+    return it == instances.end() ? nullptr : it->second;
+}
+
+K PSTREAM::write(J handle, K table){
+    PSTREAM* stream = getInstance(handle);
+    if(!stream) return kerror("Stream not open");
+    try{
+        stream->append(table);
+        return kb(1);
+    }catch (const std::exception& e) {
+            char* error = const_cast<char*>(e.what());
+            return orr(error);
+    }
+}
+
+K PSTREAM::flush(J handle){
+    PSTREAM* stream = getInstance(handle);
+    if(!stream) return kerror("Stream not open");
+    std::unique_lock<std::mutex> lock(stream->mutex);
+    if(stream->active.rows && stream->error.empty())
+        stream->enqueue(lock);
+    //Wait for the row group to be written before returning
+    stream->cv.wait(lock, [stream]{ return !stream->hasPending || !stream->error.empty(); });
+    if(!stream->error.empty())
+        return kerror(stream->error);
+    return kb(1);
+}
+
+K PSTREAM::stats(J handle){
+    PSTREAM* stream = getInstance(handle);
+    if(!stream) return kerror("Stream not open");
+    std::unique_lock<std::mutex> lock(stream->mutex);
+    K keys = ktn(KS, 0);
+    for(auto key : {"bufferedRows", "bufferedBytes", "pending", "rowsWritten", "rowGroups", "waits"})
+        js(&keys, ss(const_cast<S>(key)));
+    return xD(keys, knk(6, kj(stream->active.rows), kj(stream->active.bytes), kb(stream->hasPending),
+                        kj(stream->rowsWritten), kj(stream->rowGroups), kj(stream->waits)));
+}
+
+K PSTREAM::close(J handle){
+    PSTREAM* stream = getInstance(handle);
+    if(!stream) return kerror("Stream not open");
+    instances.erase(handle);
+    std::unique_ptr<PSTREAM> owned(stream);
+    try{
+        stream->finish();
+        return kb(1);
+    }catch (const std::exception& e) {
+            char* error = const_cast<char*>(e.what());
+            return orr(error);
+    }
+}
+
+void PSTREAM::append(K table){
+    K colNames = kK(table->k)[0];
+    K colValues = kK(table->k)[1];
+    if(colNames->n != static_cast<J>(names.size()) || !std::equal(names.begin(), names.end(), kS(colNames)))
+        throw std::runtime_error("Columns don't match the stream");
+    for(int i=0;i<colValues->n;i++){
+        int type = kK(colValues)[i]->t;
+        if(type != active.columns[i].type && !(active.columns[i].type == KS && 20 <= type && type <= 76))
+            throw std::runtime_error(std::string{"Column type doesn't match the stream: "} + names[i]);
+        K col = kK(colValues)[i];
+        if(active.columns[i].itemType)
+            for(J j=0;j<col->n;j++)
+                if(kK(col)[j]->n && kK(col)[j]->t != active.columns[i].itemType)
+                    throw std::runtime_error(std::string{"List items don't match the stream: "} + names[i]);
+    }
+
+    //Enumerations are resolved before taking the lock as that calls back into q
+    std::vector<K> cols;
+    for(int i=0;i<colValues->n;i++){
+        K col = kK(colValues)[i];
+        if(20 <= col->t && col->t <= 76){
+            K domain = WRITER::enumDomain(col);
+            K syms = ktn(KS, col->n);
+            for(J j=0;j<col->n;j++){
+                if(kJ(col)[j] < 0 || kJ(col)[j] >= domain->n){
+                    r0(syms);
+                    r0(domain);
+                    for(auto c : cols) r0(c);
+                    throw std::runtime_error("Enumeration index out of range of its domain");
+                }
+                kS(syms)[j] = kS(domain)[kJ(col)[j]];
+            }
+            r0(domain);
+            cols.push_back(syms);
+        } else
+            cols.push_back(r1(col));
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if(!error.empty()){
+        for(auto c : cols) r0(c);
+        throw std::runtime_error(error);
+    }
+    if(!active.rows)
+        active.first = std::chrono::steady_clock::now();
+    int64_t before = 0;
+    for(auto& column : active.columns)
+        before += column.values.size() + column.bytes.size() + column.syms.size() * sizeof(S);
+    for(size_t i=0;i<cols.size();i++){
+        appendColumn(active.columns[i], cols[i], 0, cols[i]->n);
+        r0(cols[i]);
+    }
+    int64_t after = 0;
+    for(auto& column : active.columns)
+        after += column.values.size() + column.bytes.size() + column.syms.size() * sizeof(S);
+    active.rows += colValues->n ? kK(colValues)[0]->n : 0;
+    active.bytes += after - before;
+
+    if(active.rows >= maxRows || active.bytes >= maxBytes)
+        enqueue(lock);
+}
+
+void PSTREAM::enqueue(std::unique_lock<std::mutex>& lock){
+    //Backpressure: only one row group can be waiting on the background thread
+    if(hasPending){
+        waits++;
+        cv.wait(lock, [this]{ return !hasPending || !error.empty(); });
+        if(!error.empty())
+            throw std::runtime_error(error);
+    }
+    std::swap(active, pending);
+    clearBuffer(active);
+    hasPending = true;
+    cv.notify_all();
+}
+
+void PSTREAM::run(){
+    THREADS::pin();
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+        if(maxMillis > 0)
+            cv.wait_for(lock, std::chrono::milliseconds(maxMillis), [this]{ return hasPending || stopping; });
+        else
+            cv.wait(lock, [this]{ return hasPending || stopping; });
+
+        //Time threshold, rows have sat in the active buffer for too long
+        if(!hasPending && !stopping && maxMillis > 0 && active.rows &&
+           std::chrono::steady_clock::now() - active.first >= std::chrono::milliseconds(maxMillis)){
+            std::swap(active, pending);
+            clearBuffer(active);
+            hasPending = true;
+        }
+
+        if(hasPending){
+            //Encoding, compression and IO happen outside the lock so q can keep appending
+            lock.unlock();
+            std::string failure;
+            try{
+                THREADS::Busy busy;
+                parquet::RowGroupWriter* rg_writer = fileWriter_->AppendRowGroup();
+                for(auto& column : pending.columns)
+                    writeBuffer(column, pending.rows, rg_writer->NextColumn());
+                rg_writer->Close();
+            }catch (const std::exception& e) {
+                failure = e.what();
+            }
+            lock.lock();
+            if(failure.empty()){
+                rowsWritten += pending.rows;
+                rowGroups++;
+            } else
+                error = failure;
+            clearBuffer(pending);
+            hasPending = false;
+            cv.notify_all();
+            if(!error.empty())
+                return;
+        } else if(stopping)
+            return;
+    }
+}
+
+void PSTREAM::clearBuffer(Buffer& buffer){
+    //Clearing keeps the capacity, so the two buffers are reused rather than reallocated
+    for(auto& column : buffer.columns)
+        clearColumn(column);
+    buffer.rows = 0;
+    buffer.bytes = 0;
+}
+
+void PSTREAM::clearColumn(ColumnBuffer& buffer){
+    buffer.defLevels.clear();
+    buffer.repLevels.clear();
+    buffer.values.clear();
+    buffer.bytes.clear();
+    buffer.lengths.clear();
+    buffer.syms.clear();
+}
+
+void PSTREAM::appendColumn(ColumnBuffer& buffer, K col, J offset, J len){
+    int type = col->t;
+    if(type == 0 && buffer.itemType)
+        appendList(buffer, col, offset, len);
+    else if(type == KB || type == KG)
+        appendValues<G>(buffer, kG(col) + offset, len, [](G){ return false; }, [](G n){ return n; });
+    #if KXVER>=3
+    else if(type == UU)
+        appendValues<U>(buffer, kU(col) + offset, len,
+                        [](const U& n){ return std::all_of(n.g, n.g + 16, [](G b){ return !b; }); },
+                        [](const U& n){ return n; });
+    #endif
+    else if(type == KH)
+        appendValues<int32_t>(buffer, kH(col) + offset, len,
+                              [](H n){ return n == static_cast<H>(nh); }, [](H n){ return static_cast<int32_t>(n); });
+    else if(type == KI || type == KM || type == KU || type == KV || type == KT)
+        appendValues<int32_t>(buffer, kI(col) + offset, len, [](I n){ return n == ni; }, [](I n){ return n; });
+    else if(type == KD)
+        appendValues<int32_t>(buffer, kI(col) + offset, len, [](I n){ return n == ni; }, [](I n){ return n + 10957; });
+    else if(type == KJ || type == KN)
+        appendValues<int64_t>(buffer, kJ64(col) + offset, len, [](J64 n){ return n == nj; }, [](J64 n){ return n; });
+    else if(type == KP)
+        appendValues<int64_t>(buffer, kJ64(col) + offset, len,
+                              [](J64 n){ return n == nj; }, [](J64 n){ return n + 946684800000000000; });
+    else if(type == KE)
+        appendValues<float>(buffer, kE(col) + offset, len, [](E n){ return n != n; }, [](E n){ return n; });
+    else if(type == KF || type == KZ)
+        appendValues<double>(buffer, kF(col) + offset, len, [](F n){ return n != n; }, [](F n){ return n; });
+    else if(type == KS)
+        appendSyms(buffer, kS(col) + offset, len);
+    else if(type == KC)
+        for(J i=offset;i<offset+len;i++)
+            appendBytes(buffer, &kG(col)[i], 1);
+    else
+        for(J i=offset;i<offset+len;i++)
+            appendBytes(buffer, kG(kK(col)[i]), kK(col)[i]->n);
+}
+
+void PSTREAM::appendList(ColumnBuffer& buffer, K col, J offset, J len){
+    //Each item is appended as a column of its own, then its levels are moved down to the element
+    int16_t maxDef = buffer.optional ? 2 : 1;
+    for(J i=offset;i<offset+len;i++){
+        K item = kK(col)[i];
+        if(!item->n){
+            buffer.defLevels.push_back(0);
+            buffer.repLevels.push_back(0);
+            continue;
+        }
+        if(item->t != buffer.itemType)
+            throw std::runtime_error("List items must all be of the column's type");
+        size_t levels = buffer.defLevels.size();
+        appendColumn(buffer, item, 0, item->n);
+        if(buffer.optional)
+            std::for_each(buffer.defLevels.begin() + levels, buffer.defLevels.end(), [](int16_t& n){ n++; });
+        else
+            buffer.defLevels.resize(levels + item->n, maxDef);
+        buffer.repLevels.push_back(0);
+        buffer.repLevels.resize(levels + item->n, 1);
+    }
+}
+
+template<typename P, typename V, typename IsNull, typename Convert>
+void PSTREAM::appendValues(ColumnBuffer& buffer, const V* values, J len, IsNull isNull, Convert convert){
+    size_t offset = buffer.values.size();
+    buffer.values.resize(offset + len * sizeof(P));
+    P* out = reinterpret_cast<P*>(&buffer.values[offset]);
+    if(!buffer.optional){
+        std::transform(values, values + len, out, convert);
+        return;
+    }
+    //Optional columns keep definition levels and only the non-null values
+    size_t levels = buffer.defLevels.size();
+    buffer.defLevels.resize(levels + len);
+    J count = 0;
+    for(J i=0;i<len;i++){
+        buffer.defLevels[levels + i] = !isNull(values[i]);
+        out[count] = convert(values[i]);
+        count += buffer.defLevels[levels + i];
+    }
+    buffer.values.resize(offset + count * sizeof(P));
+}
+
+void PSTREAM::appendSyms(ColumnBuffer& buffer, const S* syms, J len){
+    //Interned syms live as long as the process, so only the pointers are kept
+    if(!buffer.optional){
+        buffer.syms.insert(buffer.syms.end(), syms, syms + len);
+        return;
+    }
+    for(J i=0;i<len;i++){
+        buffer.defLevels.push_back(*syms[i] != 0);
+        if(*syms[i])
+            buffer.syms.push_back(syms[i]);
+    }
+}
+
+void PSTREAM::appendBytes(ColumnBuffer& buffer, const G* bytes, J len){
+    buffer.bytes.insert(buffer.bytes.end(), bytes, bytes + len);
+    buffer.lengths.push_back(len);
+}
+
+void PSTREAM::writeBuffer(ColumnBuffer& buffer, int64_t rows, parquet::ColumnWriter* writer){
+    //A LIST column has a level for every element and every empty list rather than one per row
+    int16_t* defLevels = buffer.optional || buffer.itemType ? buffer.defLevels.data() : nullptr;
+    int16_t* repLevels = buffer.itemType ? buffer.repLevels.data() : nullptr;
+    if(buffer.itemType)
+        rows = buffer.repLevels.size();
+    switch(writer->type()){
+        case Type::BOOLEAN:
+            static_cast<parquet::BoolWriter*>(writer)->WriteBatch(rows, defLevels, repLevels,
+                reinterpret_cast<bool*>(buffer.values.data()));
+            break;
+        case Type::INT32:
+            static_cast<parquet::Int32Writer*>(writer)->WriteBatch(rows, defLevels, repLevels,
+                reinterpret_cast<int32_t*>(buffer.values.data()));
+            break;
+        case Type::INT64:
+            static_cast<parquet::Int64Writer*>(writer)->WriteBatch(rows, defLevels, repLevels,
+                reinterpret_cast<int64_t*>(buffer.values.data()));
+            break;
+        case Type::FLOAT:
+            static_cast<parquet::FloatWriter*>(writer)->WriteBatch(rows, defLevels, repLevels,
+                reinterpret_cast<float*>(buffer.values.data()));
+            break;
+        case Type::DOUBLE:
+            static_cast<parquet::DoubleWriter*>(writer)->WriteBatch(rows, defLevels, repLevels,
+                reinterpret_cast<double*>(buffer.values.data()));
+            break;
+        case Type::FIXED_LEN_BYTE_ARRAY:{
+            int size = writer->descr()->type_length();
+            std::vector<parquet::FixedLenByteArray> values;
+            for(size_t i=0;i<buffer.values.size();i+=size)
+                values.push_back(parquet::FixedLenByteArray(&buffer.values[i]));
+            static_cast<parquet::FixedLenByteArrayWriter*>(writer)->WriteBatch(rows, defLevels, repLevels, values.data());
+            break;
+        }
+        default:{
+            std::vector<parquet::ByteArray> values;
+            if(buffer.type == KS)
+                for(auto sym : buffer.syms)
+                    values.push_back(parquet::ByteArray(std::strlen(sym), reinterpret_cast<uint8_t*>(sym)));
+            else{
+                size_t offset = 0;
+                for(auto len : buffer.lengths){
+                    values.push_back(parquet::ByteArray(len, &buffer.bytes[offset]));
+                    offset += len;
+                }
+            }
+            static_cast<parquet::ByteArrayWriter*>(writer)->WriteBatch(rows, defLevels, repLevels, values.data());
+        }
+    }
+}
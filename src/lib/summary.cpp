@@ -0,0 +1,309 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <summary.hpp>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <parquet/file_writer.h>
+
+using namespace KDB::PARQ;
+
+const std::string SUMMARY::metadataFile {"_metadata"};
+const std::string SUMMARY::commonFile {"_common_metadata"};
+std::mutex SUMMARY::mutex;
+
+namespace{
+    std::shared_ptr<parquet::FileMetaData> copy(const parquet::FileMetaData& metadata){
+        std::vector<int> rowGroups(metadata.num_row_groups());
+        std::iota(rowGroups.begin(), rowGroups.end(), 0);
+        return metadata.Subset(rowGroups);
+    }
+
+    void append(std::shared_ptr<parquet::FileMetaData>& merged, const std::string& path,
+                std::shared_ptr<parquet::FileMetaData> metadata){
+        metadata = copy(*metadata);
+        metadata->set_file_path(path);
+        if(!merged){
+            merged = metadata;
+            return;
+        }
+        if(!merged->schema()->Equals(*metadata->schema()))
+            throw std::runtime_error("Schema of " + path + " doesn't match the rest of the dataset");
+        merged->AppendRowGroups(*metadata);
+    }
+
+    std::shared_ptr<parquet::FileMetaData> merge(const std::string& root, const std::vector<std::string>& paths, K props){
+        std::shared_ptr<parquet::FileMetaData> merged;
+        for(auto& path : paths)
+            append(merged, SUMMARY::relative(root, path), PREADER::open_reader(path, props)->metadata());
+        if(!merged)
+            throw std::runtime_error("No parquet files in " + root);
+        return merged;
+    }
+
+    template<typename T, typename V>
+    bool within(const T& min, const T& max, const std::optional<V>& low, const std::optional<V>& high){
+        return !(low && max < *low) && !(high && *high < min);
+    }
+}
+
+K SUMMARY::write(const std::string& root, K props){
+    std::vector<std::string> paths = scan(root);
+    std::lock_guard<std::mutex> lock(mutex);
+    save(root, *merge(root, paths, props));
+    return kj(paths.size());
+}
+
+K SUMMARY::update(const std::string& root, K files, K props){
+    Files metadata;
+    for(auto& path : k2StrVec(files))
+        metadata.emplace_back(relative(root, path), PREADER::open_reader(path, props)->metadata());
+    update(root, metadata, props);
+    return kb(1);
+}
+
+void SUMMARY::update(const std::string& fileName, std::shared_ptr<parquet::FileMetaData> metadata){
+    std::string root = std::filesystem::path(fileName).parent_path().string();
+    if(root.empty())
+        root = ".";
+    update(root, Files {{relative(root, fileName), metadata}});
+}
+
+void SUMMARY::update(const std::string& root, const Files& files, K props){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<parquet::FileMetaData> merged;
+    std::string path = root + "/" + metadataFile;
+    std::set<std::string> names;
+    for(auto& entry : files)
+        names.insert(entry.first);
+    if(std::filesystem::exists(path)){
+        std::shared_ptr<arrow::io::ReadableFile> file;
+        PARQUET_ASSIGN_OR_THROW(file, arrow::io::ReadableFile::Open(path, &POOL::getInstance()));
+        merged = parquet::ReadMetaData(file);
+        //A rewritten file replaces its old row groups
+        std::vector<int> keep;
+        for(int i=0;i<merged->num_row_groups();i++){
+            std::unique_ptr<parquet::RowGroupMetaData> rowGroup = merged->RowGroup(i);
+            if(!rowGroup->num_columns() || !names.count(rowGroup->ColumnChunk(0)->file_path()))
+                keep.push_back(i);
+        }
+        merged = merged->Subset(keep);
+    }
+    else{
+        //A new summary starts from the files already there, or planning would only see the ones written with it
+        std::vector<std::string> existing;
+        for(auto& found : scan(root))
+            if(!names.count(relative(root, found)))
+                existing.push_back(found);
+        if(!existing.empty())
+            merged = merge(root, existing, props);
+    }
+    for(auto& entry : files)
+        append(merged, entry.first, entry.second);
+    save(root, *merged);
+}
+
+K SUMMARY::plan(const std::string& root, K filters, K props){
+    std::shared_ptr<parquet::FileMetaData> metadata = load(root, props);
+    K names = kK(filters)[0];
+    K ranges = kK(filters)[1];
+    std::vector<int> columns;
+    std::vector<J> scales;
+    for(J i=0;i<names->n;i++){
+        int index = metadata->schema()->ColumnIndex(kS(names)[i]);
+        if(index < 0)
+            throw std::runtime_error(std::string{"Filter column not in dataset: "} + kS(names)[i]);
+        columns.push_back(index);
+        scales.push_back(PREADER::decoder(metadata->schema()->Column(index)).scale);
+    }
+
+    K files = ktn(KS, 0);
+    K groups = ktn(KJ, 0);
+    K rows = ktn(KJ, 0);
+    //Row groups of a file are listed together in its footer order
+    std::map<std::string, J> next;
+    try{
+        for(int i=0;i<metadata->num_row_groups();i++){
+            std::unique_ptr<parquet::RowGroupMetaData> rowGroup = metadata->RowGroup(i);
+            std::string path = rowGroup->num_columns() ? rowGroup->ColumnChunk(0)->file_path() : "";
+            J group = next[path]++;
+            bool keep = true;
+            for(size_t j=0;keep && j<columns.size();j++)
+                keep = overlaps(*rowGroup->ColumnChunk(columns[j]), kK(ranges)[j], scales[j]);
+            if(!keep)
+                continue;
+            std::string file = path.empty() ? root : root + "/" + path;
+            js(&files, ss(const_cast<S>(file.c_str())));
+            ja(&groups, &group);
+            J count = rowGroup->num_rows();
+            ja(&rows, &count);
+        }
+    }catch(...){
+        r0(files);
+        r0(groups);
+        r0(rows);
+        throw;
+    }
+    K colNames = ktn(KS, 3);
+    kS(colNames)[0] = ss(const_cast<S>("file"));
+    kS(colNames)[1] = ss(const_cast<S>("rowGroup"));
+    kS(colNames)[2] = ss(const_cast<S>("rows"));
+    return xT(xD(colNames, knk(3, files, groups, rows)));
+}
+
+std::shared_ptr<parquet::FileMetaData> SUMMARY::load(const std::string& root, K props){
+    std::string path = root + "/" + metadataFile;
+    if(std::filesystem::exists(path))
+        return PREADER::open_reader(path, props)->metadata();
+    //Without a summary every footer is read, as a summary write would
+    return merge(root, scan(root), props);
+}
+
+std::vector<std::string> SUMMARY::scan(const std::string& root){
+    //Hidden and underscore prefixed entries are skipped, as Spark and Arrow do
+    std::vector<std::string> paths;
+    auto it = std::filesystem::recursive_directory_iterator(root);
+    for(auto& entry : it){
+        std::string name = entry.path().filename().string();
+        if(name[0] == '.' || name[0] == '_'){
+            if(entry.is_directory())
+                it.disable_recursion_pending();
+            continue;
+        }
+        if(entry.is_regular_file() && entry.path().extension() == ".parquet")
+            paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+std::string SUMMARY::relative(const std::string& root, const std::string& path){
+    return std::filesystem::path(path).lexically_normal().lexically_relative(
+        std::filesystem::path(root).lexically_normal()).string();
+}
+
+//Filter bounds as the values the writer stores, a null bound is open
+std::optional<J> SUMMARY::integer(K range, J i, J scale){
+    //Bounds on milli or microsecond columns are brought down to the stored units, rounding inwards
+    if(scale > 1){
+        std::optional<J> bound = integer(range, i);
+        if(bound)
+            bound = *bound / scale + (i ? -(*bound % scale < 0) : *bound % scale > 0);
+        return bound;
+    }
+    int type = range->t ? range->t : -kK(range)[i]->t;
+    K atom = range->t ? nullptr : kK(range)[i];
+    switch(type){
+        case KB: case KG:
+            return atom ? atom->g : kG(range)[i];
+        case KH:{
+            H value = atom ? atom->h : kH(range)[i];
+            return value == nh ? std::nullopt : std::optional<J>(value);
+        }
+        case KI: case KM: case KU: case KV: case KT: case KD:{
+            I value = atom ? atom->i : kI(range)[i];
+            if(value == ni) return std::nullopt;
+            return type == KD ? value + 10957 : value;
+        }
+        case KJ: case KN: case KP:{
+            J value = atom ? atom->j : kJ(range)[i];
+            if(value == nj) return std::nullopt;
+            return type == KP ? value + 946684800000000000 : value;
+        }
+        default:
+            throw std::runtime_error("Filter bounds must be integral for this column");
+    }
+}
+
+std::optional<double> SUMMARY::real(K range, J i){
+    int type = range->t ? range->t : -kK(range)[i]->t;
+    K atom = range->t ? nullptr : kK(range)[i];
+    double value;
+    if(type == KE)
+        value = atom ? atom->e : kE(range)[i];
+    else if(type == KF || type == KZ)
+        value = atom ? atom->f : kF(range)[i];
+    else{
+        std::optional<J> res = integer(range, i);
+        return res ? std::optional<double>(*res) : std::nullopt;
+    }
+    return std::isnan(value) ? std::nullopt : std::optional<double>(value);
+}
+
+std::optional<std::string> SUMMARY::bytes(K range, J i){
+    std::string value;
+    if(range->t == KS)
+        value = kS(range)[i];
+    else if(range->t == 0 && (kK(range)[i]->t == -KS || kK(range)[i]->t == KC || kK(range)[i]->t == -KC))
+        value = k2string(kK(range)[i]);
+    else
+        throw std::runtime_error("Filter bounds must be symbols or strings for this column");
+    return value.empty() ? std::nullopt : std::optional<std::string>(value);
+}
+
+bool SUMMARY::overlaps(const parquet::ColumnChunkMetaData& chunk, K range, J scale){
+    if(range->n != 2)
+        throw std::runtime_error("Filters must be a lower and upper bound");
+    std::shared_ptr<parquet::Statistics> stats = chunk.is_stats_set() ? chunk.statistics() : nullptr;
+    if(!stats || !stats->HasMinMax())
+        return true;
+    switch(stats->physical_type()){
+        case Type::INT32:{
+            auto typed = std::static_pointer_cast<parquet::Int32Statistics>(stats);
+            return within<J, J>(typed->min(), typed->max(), integer(range, 0), integer(range, 1));
+        }
+        case Type::INT64:{
+            auto typed = std::static_pointer_cast<parquet::Int64Statistics>(stats);
+            return within<J, J>(typed->min(), typed->max(), integer(range, 0, scale), integer(range, 1, scale));
+        }
+        case Type::FLOAT:{
+            auto typed = std::static_pointer_cast<parquet::FloatStatistics>(stats);
+            return within<double, double>(typed->min(), typed->max(), real(range, 0), real(range, 1));
+        }
+        case Type::DOUBLE:{
+            auto typed = std::static_pointer_cast<parquet::DoubleStatistics>(stats);
+            return within<double, double>(typed->min(), typed->max(), real(range, 0), real(range, 1));
+        }
+        case Type::BYTE_ARRAY:{
+            auto typed = std::static_pointer_cast<parquet::ByteArrayStatistics>(stats);
+            std::string min = parquet::ByteArrayToString(typed->min());
+            std::string max = parquet::ByteArrayToString(typed->max());
+            return within<std::string, std::string>(min, max, bytes(range, 0), bytes(range, 1));
+        }
+        default:
+            return true;
+    }
+}
+
+void SUMMARY::save(const std::string& root, const parquet::FileMetaData& metadata){
+    //Written beside the old files and renamed over them, readers never see a partial summary
+    auto put = [&root](const std::string& name, const parquet::FileMetaData& content){
+        std::string temp = root + "/." + name + ".tmp";
+        std::shared_ptr<arrow::io::FileOutputStream> out;
+        PARQUET_ASSIGN_OR_THROW(out, arrow::io::FileOutputStream::Open(temp));
+        parquet::WriteMetaDataFile(content, out.get());
+        PARQUET_THROW_NOT_OK(out->Close());
+        std::filesystem::rename(temp, root + "/" + name);
+    };
+    put(metadataFile, metadata);
+    put(commonFile, *metadata.Subset({}));
+}
@@ -0,0 +1,100 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <threads.hpp>
+#include <arrow/io/interfaces.h>
+#include <arrow/util/thread_pool.h>
+#include <parquet/exception.h>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace KDB::PARQ;
+
+std::atomic<J> THREADS::workerCount {std::max<J>(1, std::thread::hardware_concurrency())};
+std::atomic<J> THREADS::running {0};
+std::atomic<J> THREADS::queued {0};
+std::atomic<J> THREADS::busyNanos {0};
+std::chrono::steady_clock::time_point THREADS::since = std::chrono::steady_clock::now();
+std::vector<int> THREADS::affinity;
+std::mutex THREADS::mutex;
+
+THREADS::Busy::Busy()
+        : start(std::chrono::steady_clock::now())
+{
+    running++;
+}
+
+THREADS::Busy::~Busy(){
+    running--;
+    busyNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void THREADS::configure(int cpu, int io, int workers, const std::vector<int>& cpus){
+    PARQUET_THROW_NOT_OK(arrow::SetCpuThreadPoolCapacity(cpu));
+    PARQUET_THROW_NOT_OK(arrow::io::SetIOThreadPoolCapacity(io));
+    workerCount = workers;
+    std::lock_guard<std::mutex> lock(mutex);
+    affinity = cpus;
+    //Utilisation is measured from the last change
+    busyNanos = 0;
+    since = std::chrono::steady_clock::now();
+}
+
+J THREADS::workers(){
+    return workerCount;
+}
+
+void THREADS::pin(){
+    //Applies to the calling ParQ worker, Arrow's pools keep the affinity of the process
+    std::lock_guard<std::mutex> lock(mutex);
+    if(affinity.empty())
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : affinity)
+        CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void THREADS::enqueued(J count){
+    queued += count;
+}
+
+K THREADS::stats(){
+    arrow::internal::ThreadPool* cpuPool = arrow::internal::GetCpuThreadPool();
+    auto ioPool = dynamic_cast<arrow::internal::ThreadPool*>(arrow::io::default_io_context().executor());
+    double elapsed;
+    K cpus = ktn(KJ, 0);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+        for(J cpu : affinity)
+            ja(&cpus, &cpu);
+    }
+    J workers = workerCount;
+    K keys = ktn(KS, 0);
+    for(auto key : {"cpu", "io", "workers", "affinity", "cpuTasks", "ioTasks", "running", "queued", "utilisation"})
+        js(&keys, ss(const_cast<S>(key)));
+    return xD(keys, knk(9, kj(arrow::GetCpuThreadPoolCapacity()),
+                           kj(arrow::io::GetIOThreadPoolCapacity()),
+                           kj(workers),
+                           cpus,
+                           kj(cpuPool->GetNumTasks()),
+                           kj(ioPool ? ioPool->GetNumTasks() : nj),
+                           kj(running),
+                           kj(queued),
+                           kf(elapsed > 0 ? busyNanos / 1e9 / (elapsed * workers) : 0)));
+}
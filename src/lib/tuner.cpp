@@ -0,0 +1,194 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <tuner.hpp>
+#include <chrono>
+
+using namespace KDB::PARQ;
+
+K TUNER::tune(K table, std::string goal, double floor, K codecs, K levels, K props){
+    K colNames = kK(table->k)[0];
+    K colValues = kK(table->k)[1];
+
+    K column = ktn(KS, colNames->n);
+    K encoding = ktn(KJ, colNames->n);
+    K dictionary = ktn(KB, colNames->n);
+    K codec = ktn(KJ, colNames->n);
+    K level = ktn(KJ, colNames->n);
+    K bytes = ktn(KJ, colNames->n);
+    K ratio = ktn(KF, colNames->n);
+    K encodeMBs = ktn(KF, colNames->n);
+    K decodeMBs = ktn(KF, colNames->n);
+
+    for(int i=0;i<colNames->n;i++){
+        K name = ktn(KS, 1);
+        kS(name)[0] = kS(colNames)[i];
+        Trial best = tuneColumn(name, kK(colValues)[i], goal, floor, codecs, levels, props);
+        r0(name);
+
+        double mb = sampleBytes(kK(colValues)[i]) / 1048576.0;
+        kS(column)[i] = kS(colNames)[i];
+        kJ(encoding)[i] = best.dictionary ? parquet::Encoding::RLE_DICTIONARY : best.encoding;
+        kG(dictionary)[i] = best.dictionary;
+        kJ(codec)[i] = best.codec;
+        kJ(level)[i] = best.level;
+        kJ(bytes)[i] = best.bytes;
+        kF(ratio)[i] = best.bytes ? mb * 1048576.0 / best.bytes : 0;
+        kF(encodeMBs)[i] = best.encodeSeconds > 0 ? mb / best.encodeSeconds : 0;
+        kF(decodeMBs)[i] = best.decodeSeconds > 0 ? mb / best.decodeSeconds : 0;
+    }
+
+    K names = ktn(KS, 0);
+    for(auto n : {"column", "encoding", "dictionary", "codec", "level", "bytes", "ratio", "encodeMBs", "decodeMBs"})
+        js(&names, ss(const_cast<S>(n)));
+    return xT(xD(names, knk(9, column, encoding, dictionary, codec, level, bytes, ratio, encodeMBs, decodeMBs)));
+}
+
+TUNER::Trial TUNER::tuneColumn(K name, K col, std::string goal, double floor,
+                               K codecs, K levels, K props){
+    K values = ktn(0, 1);
+    kK(values)[0] = r1(col);
+    parquet::SchemaDescriptor schema;
+    schema.Init(WRITER::SetupSchema(name, values, 1, dictBool(props, "nullable", false)));
+    Type::type physicalType = schema.Column(0)->physical_type();
+
+    std::vector<Trial> trials;
+    for(auto encoding : encodings(physicalType)){
+        for(int i=0;i<codecs->n;i++){
+            auto codec = parquet::Compression::type(kJ(codecs)[i]);
+            if(!arrow::util::Codec::IsAvailable(codec))
+                continue;
+            Trial trial {encoding.first, encoding.second, codec, kJ(levels)[i], 0, 0, 0};
+            //Encodings the writer can't apply to this type are dropped
+            if(runTrial(name, values, props, trial))
+                trials.push_back(trial);
+        }
+    }
+    r0(values);
+    if(trials.empty())
+        throw std::runtime_error(std::string{"Unable to tune column "} + kS(name)[0]);
+
+    double mb = sampleBytes(col) / 1048576.0;
+    auto smallest = [](const Trial& a, const Trial& b){
+        return a.bytes < b.bytes || (a.bytes == b.bytes && a.decodeSeconds < b.decodeSeconds);
+    };
+    auto fastest = [](const Trial& a, const Trial& b){
+        return a.decodeSeconds < b.decodeSeconds || (a.decodeSeconds == b.decodeSeconds && a.bytes < b.bytes);
+    };
+
+    if(goal == "smallest")
+        return *std::min_element(trials.begin(), trials.end(), smallest);
+    if(goal == "fastest")
+        return *std::min_element(trials.begin(), trials.end(), fastest);
+
+    //Throughput floor: smallest of the trials that decode at least floor MB/s
+    std::vector<Trial> passed;
+    std::copy_if(trials.begin(), trials.end(), std::back_inserter(passed),
+                 [mb, floor](const Trial& t){ return t.decodeSeconds <= 0 || mb / t.decodeSeconds >= floor; });
+    if(passed.empty())
+        return *std::min_element(trials.begin(), trials.end(), fastest);
+    return *std::min_element(passed.begin(), passed.end(), smallest);
+}
+
+bool TUNER::runTrial(K names, K values, K props, Trial& trial){
+    try{
+        std::string name {kS(names)[0]};
+        parquet::WriterProperties::Builder builder;
+        WRITER::FileProperties(builder, trial.codec, props);
+        if(trial.level != nj)
+            builder.compression_level(name, trial.level);
+        if(trial.dictionary)
+            builder.enable_dictionary(name);
+        else{
+            builder.disable_dictionary(name);
+            builder.encoding(name, trial.encoding);
+        }
+
+        PARQUET_ASSIGN_OR_THROW(std::shared_ptr<arrow::io::BufferOutputStream> sink,
+                                arrow::io::BufferOutputStream::Create(4096, &POOL::getInstance()));
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<GroupNode> schema = WRITER::SetupSchema(names, values, 1, dictBool(props, "nullable", false));
+        std::shared_ptr<parquet::ParquetFileWriter> file_writer =
+            parquet::ParquetFileWriter::Open(sink, schema, builder.build());
+        WRITER::writeColumn(kK(values)[0], file_writer->AppendRowGroup());
+        file_writer->Close();
+        trial.encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        trial.bytes = file_writer->metadata()->RowGroup(0)->ColumnChunk(0)->total_compressed_size();
+        PARQUET_ASSIGN_OR_THROW(std::shared_ptr<arrow::Buffer> buffer, sink->Finish());
+
+        //Best of a few runs to keep timer noise out of small samples
+        trial.decodeSeconds = std::numeric_limits<double>::max();
+        for(int i=0;i<3;i++){
+            start = std::chrono::steady_clock::now();
+            std::unique_ptr<parquet::ParquetFileReader> reader =
+                parquet::ParquetFileReader::Open(std::make_shared<arrow::io::BufferReader>(buffer),
+                                                 parquet::ReaderProperties(&POOL::getInstance()));
+            std::shared_ptr<parquet::RowGroupReader> row_group_reader = reader->RowGroup(0);
+            K res = PREADER::readColumns(row_group_reader->Column(0), row_group_reader->metadata()->num_rows());
+            trial.decodeSeconds = std::min(trial.decodeSeconds,
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            if(res) r0(res);
+        }
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+std::vector<std::pair<parquet::Encoding::type, bool>> TUNER::encodings(Type::type physicalType){
+    //Pairs of encoding and dictionary on/off, with the dictionary the encoding is unused
+    switch(physicalType){
+        case Type::BOOLEAN:
+            return {{parquet::Encoding::PLAIN, false}, {parquet::Encoding::RLE, false}};
+        case Type::INT32:
+        case Type::INT64:
+            return {{parquet::Encoding::PLAIN, true}, {parquet::Encoding::PLAIN, false},
+                    {parquet::Encoding::DELTA_BINARY_PACKED, false}, {parquet::Encoding::BYTE_STREAM_SPLIT, false}};
+        case Type::FLOAT:
+        case Type::DOUBLE:
+            return {{parquet::Encoding::PLAIN, true}, {parquet::Encoding::PLAIN, false},
+                    {parquet::Encoding::BYTE_STREAM_SPLIT, false}};
+        case Type::BYTE_ARRAY:
+            return {{parquet::Encoding::PLAIN, true}, {parquet::Encoding::PLAIN, false},
+                    {parquet::Encoding::DELTA_LENGTH_BYTE_ARRAY, false}, {parquet::Encoding::DELTA_BYTE_ARRAY, false}};
+        default:
+            return {{parquet::Encoding::PLAIN, true}, {parquet::Encoding::PLAIN, false},
+                    {parquet::Encoding::BYTE_STREAM_SPLIT, false}};
+    }
+}
+
+J TUNER::sampleBytes(K col){
+    switch(col->t){
+        case 0:{
+            J total = 0;
+            for(J i=0;i<col->n;i++)
+                total += sampleBytes(kK(col)[i]);
+            return total;
+        }
+        case KB: case KG: case KC:
+            return col->n;
+        case KH:
+            return 2 * col->n;
+        case KI: case KE: case KM: case KD: case KU: case KV: case KT:
+            return 4 * col->n;
+        #if KXVER>=3
+        case UU:
+            return 16 * col->n;
+        #endif
+        default:
+            return col->t > 0 ? 8 * col->n : 0;
+    }
+}
@@ -0,0 +1,320 @@
+/*
+   Copyright 2020 Brian O'Sullivan
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <uring.hpp>
+#include <arrow/io/file.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace KDB::PARQ;
+
+namespace{
+    template<typename T>
+    T* at(void* ring, unsigned offset){
+        return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+    }
+
+    void* map(size_t size, int fd, off_t offset){
+        void* res = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return res == MAP_FAILED ? nullptr : res;
+    }
+}
+
+URING::URING(unsigned entries)
+        : fd(-1), entries(0), sqRing(nullptr), cqRing(nullptr), sqSize(0), cqSize(0), sqes(nullptr), sqesSize(0)
+{
+    #ifdef __NR_io_uring_setup
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(fd < 0)
+        throw std::runtime_error(std::string{"io_uring_setup failed: "} + std::strerror(errno));
+    this->entries = params.sq_entries;
+    sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    //Newer kernels share one mapping between both rings
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single)
+        sqSize = cqSize = std::max(sqSize, cqSize);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqRing = map(sqSize, fd, IORING_OFF_SQ_RING);
+    cqRing = single ? sqRing : map(cqSize, fd, IORING_OFF_CQ_RING);
+    sqes = static_cast<io_uring_sqe*>(map(sqesSize, fd, IORING_OFF_SQES));
+    if(!sqRing || !cqRing || !sqes){
+        int error = errno;
+        release();
+        throw std::runtime_error(std::string{"io_uring mmap failed: "} + std::strerror(error));
+    }
+    sqHead = at<unsigned>(sqRing, params.sq_off.head);
+    sqTail = at<unsigned>(sqRing, params.sq_off.tail);
+    sqMask = at<unsigned>(sqRing, params.sq_off.ring_mask);
+    sqArray = at<unsigned>(sqRing, params.sq_off.array);
+    cqHead = at<unsigned>(cqRing, params.cq_off.head);
+    cqTail = at<unsigned>(cqRing, params.cq_off.tail);
+    cqMask = at<unsigned>(cqRing, params.cq_off.ring_mask);
+    cqes = at<io_uring_cqe>(cqRing, params.cq_off.cqes);
+    #else
+    throw std::runtime_error("io_uring isn't supported by this build");
+    #endif
+}
+
+URING::~URING(){
+    release();
+}
+
+void URING::release(){
+    if(sqes) munmap(sqes, sqesSize);
+    if(cqRing && cqRing != sqRing) munmap(cqRing, cqSize);
+    if(sqRing) munmap(sqRing, sqSize);
+    if(fd >= 0) close(fd);
+    sqes = nullptr;
+    sqRing = cqRing = nullptr;
+    fd = -1;
+}
+
+bool URING::available(){
+    //Kernels without io_uring, or containers that block it, are only probed once
+    static bool res = []{
+        try{
+            URING ring {1};
+            return true;
+        }catch(const std::exception&){
+            return false;
+        }
+    }();
+    return res;
+}
+
+URING& URING::local(unsigned entries){
+    thread_local std::unique_ptr<URING> ring;
+    if(!ring || ring->entries < entries){
+        ring.reset();
+        ring = std::make_unique<URING>(entries);
+    }
+    return *ring;
+}
+
+void URING::run(std::vector<Request>& requests){
+    #ifdef __NR_io_uring_enter
+    size_t next = 0;
+    size_t done = 0;
+    unsigned inflight = 0;
+    while(done < requests.size()){
+        unsigned tail = *sqTail;
+        while(next < requests.size() && inflight < entries){
+            Request& request = requests[next];
+            unsigned index = tail & *sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = request.opcode;
+            sqe->fd = request.fd;
+            sqe->addr = reinterpret_cast<uint64_t>(request.buffer);
+            sqe->len = request.length;
+            sqe->off = request.offset;
+            sqe->user_data = next;
+            sqArray[index] = index;
+            tail++;
+            next++;
+            inflight++;
+        }
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+        //Entries the kernel hasn't taken yet are resubmitted after an interrupted call
+        unsigned pending = tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if(syscall(__NR_io_uring_enter, fd, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+           && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            throw std::runtime_error(std::string{"io_uring_enter failed: "} + std::strerror(errno));
+
+        unsigned head = *cqHead;
+        while(head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)){
+            io_uring_cqe* cqe = &cqes[head & *cqMask];
+            requests[cqe->user_data].result = cqe->res;
+            head++;
+            inflight--;
+            done++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+    #endif
+}
+
+arrow::Result<std::shared_ptr<arrow::io::RandomAccessFile>> URINGFILE::Open(const std::string& path, bool direct,
+                                                                            int64_t depth, int64_t blockSize,
+                                                                            arrow::MemoryPool* pool){
+    if(!URING::available())
+        return arrow::io::ReadableFile::Open(path, pool);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | (direct ? O_DIRECT : 0));
+    //Filesystems such as tmpfs refuse O_DIRECT, read those through the page cache
+    if(fd < 0 && direct && errno == EINVAL){
+        direct = false;
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if(fd < 0)
+        return arrow::Status::IOError("Failed to open local file '", path, "'. Detail: ", std::strerror(errno));
+    struct stat st;
+    if(fstat(fd, &st) < 0){
+        int error = errno;
+        close(fd);
+        return arrow::Status::IOError("Failed to stat '", path, "'. Detail: ", std::strerror(error));
+    }
+    blockSize = std::max<int64_t>(blockSize, directAlignment) / directAlignment * directAlignment;
+    return std::shared_ptr<arrow::io::RandomAccessFile>(
+        new URINGFILE(fd, direct, st.st_size, std::max<int64_t>(depth, 1), blockSize, pool));
+}
+
+URINGFILE::URINGFILE(int fd, bool direct, int64_t size, unsigned depth, int64_t blockSize, arrow::MemoryPool* pool)
+        : fd(fd), direct(direct), size(size), depth(depth), blockSize(blockSize), position(0), pool(pool)
+{
+}
+
+URINGFILE::~URINGFILE(){
+    if(fd >= 0) close(fd);
+}
+
+arrow::Status URINGFILE::Close(){
+    if(fd >= 0 && close(fd) < 0){
+        fd = -1;
+        return arrow::Status::IOError("Failed to close file. Detail: ", std::strerror(errno));
+    }
+    fd = -1;
+    return arrow::Status::OK();
+}
+
+bool URINGFILE::closed() const{
+    return fd < 0;
+}
+
+arrow::Result<int64_t> URINGFILE::Tell() const{
+    return position;
+}
+
+arrow::Status URINGFILE::Seek(int64_t position){
+    if(position < 0)
+        return arrow::Status::Invalid("Negative seek position");
+    this->position = position;
+    return arrow::Status::OK();
+}
+
+arrow::Result<int64_t> URINGFILE::GetSize(){
+    return size;
+}
+
+arrow::Result<int64_t> URINGFILE::Read(int64_t nbytes, void* out){
+    ARROW_ASSIGN_OR_RAISE(int64_t read, ReadAt(position, nbytes, out));
+    position += read;
+    return read;
+}
+
+arrow::Result<std::shared_ptr<arrow::Buffer>> URINGFILE::Read(int64_t nbytes){
+    ARROW_ASSIGN_OR_RAISE(std::shared_ptr<arrow::Buffer> buffer, ReadAt(position, nbytes));
+    position += buffer->size();
+    return buffer;
+}
+
+arrow::Result<int64_t> URINGFILE::ReadAt(int64_t position, int64_t nbytes, void* out){
+    ARROW_ASSIGN_OR_RAISE(std::shared_ptr<arrow::Buffer> buffer, ReadAt(position, nbytes));
+    std::memcpy(out, buffer->data(), buffer->size());
+    return buffer->size();
+}
+
+arrow::Result<std::shared_ptr<arrow::Buffer>> URINGFILE::ReadAt(int64_t position, int64_t nbytes){
+    ARROW_ASSIGN_OR_RAISE(auto buffers, readMany({{position, nbytes}}));
+    return buffers[0];
+}
+
+std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>> URINGFILE::ReadManyAsync(
+        const arrow::io::IOContext& /*ctx*/, const std::vector<arrow::io::ReadRange>& ranges){
+    //Pre-buffering hands over every coalesced range at once, which go out as one batch.
+    //The batch completes before returning, as the reader waits on it straight after.
+    std::vector<arrow::Future<std::shared_ptr<arrow::Buffer>>> futures;
+    auto buffers = readMany(ranges);
+    for(size_t i=0;i<ranges.size();i++)
+        futures.push_back(buffers.ok() ? arrow::Future<std::shared_ptr<arrow::Buffer>>::MakeFinished((*buffers)[i])
+                                       : arrow::Future<std::shared_ptr<arrow::Buffer>>::MakeFinished(buffers.status()));
+    return futures;
+}
+
+arrow::Result<std::vector<std::shared_ptr<arrow::Buffer>>> URINGFILE::readMany(
+        const std::vector<arrow::io::ReadRange>& ranges){
+    if(fd < 0)
+        return arrow::Status::Invalid("Operation on closed file");
+    std::vector<std::shared_ptr<arrow::Buffer>> buffers;
+    std::vector<URING::Request> requests;
+    std::vector<std::pair<int64_t, int64_t>> slices;
+    for(auto& range : ranges){
+        if(range.offset < 0 || range.length < 0)
+            return arrow::Status::Invalid("Invalid read range ", range.offset, " ", range.length);
+        //Reads past the end are cut short, as with pread
+        int64_t length = std::max<int64_t>(0, std::min(range.length, size - range.offset));
+        int64_t start = range.offset;
+        int64_t end = range.offset + length;
+        if(direct){
+            start = start / directAlignment * directAlignment;
+            end = (end + directAlignment - 1) / directAlignment * directAlignment;
+        }
+        ARROW_ASSIGN_OR_RAISE(std::shared_ptr<arrow::Buffer> buffer,
+                              arrow::AllocateBuffer(end - start, direct ? directAlignment : arrow::kDefaultBufferAlignment,
+                                                    pool));
+        for(int64_t offset=start; offset<end; offset+=blockSize)
+            requests.push_back({IORING_OP_READ, fd, buffer->mutable_data() + (offset - start),
+                                static_cast<unsigned>(std::min(blockSize, end - offset)), offset, 0});
+        buffers.push_back(buffer);
+        slices.push_back({range.offset - start, length});
+    }
+
+    try{
+        URING::local(depth).run(requests);
+    }catch(const std::exception&){
+        //A ring this thread can't set up, such as over the locked memory limit, reads with pread instead
+        for(auto& request : requests)
+            request.result = -ENOSYS;
+    }
+    for(auto& request : requests){
+        int64_t done = request.result;
+        if(done == -EINVAL || done == -EOPNOTSUPP || done == -ENOSYS || done == -EINTR || done == -EAGAIN)
+            done = 0;
+        else if(done < 0)
+            return arrow::Status::IOError("io_uring read failed. Detail: ", std::strerror(-done));
+        //Reads are only short at the end of the file, or when a retry is needed
+        if(done < request.length && request.offset + done < size)
+            ARROW_RETURN_NOT_OK(readBlock(static_cast<uint8_t*>(request.buffer), request.length, request.offset, done));
+    }
+
+    for(size_t i=0;i<buffers.size();i++)
+        buffers[i] = arrow::SliceBuffer(buffers[i], slices[i].first, slices[i].second);
+    return buffers;
+}
+
+arrow::Status URINGFILE::readBlock(uint8_t* buffer, int64_t length, int64_t offset, int64_t done){
+    //Finishes a short or unsupported read synchronously, stopping at the end of the file
+    while(done < length){
+        ssize_t res = pread(fd, buffer + done, length - done, offset + done);
+        if(res < 0 && errno == EINTR)
+            continue;
+        if(res < 0)
+            return arrow::Status::IOError("Error reading bytes from file. Detail: ", std::strerror(errno));
+        if(res == 0)
+            break;
+        done += res;
+    }
+    return arrow::Status::OK();
+}
@@ -44,4 +44,49 @@ std::vector<std::string> k2StrVec(K x){
 
 K string2k(std::string x){
     return kp(const_cast<char*>(x.c_str()));
-}
\ No newline at end of file
+}
+
+J dictIndex(K dict, std::string key){
+    if(!dict || dict->t != XD || kK(dict)[0]->t != KS)
+        return -1;
+    K keys = kK(dict)[0];
+    for(J i=0;i<keys->n;i++)
+        if(key == kS(keys)[i])
+            return i;
+    return -1;
+}
+
+K dictGet(K dict, std::string key){
+    //Only general lists hold K objects, typed values are read with dictLong/dictBool
+    J index = dictIndex(dict, key);
+    if(index < 0 || kK(dict)[1]->t != 0)
+        return nullptr;
+    return kK(kK(dict)[1])[index];
+}
+
+J dictLong(K dict, std::string key, J fallback){
+    J index = dictIndex(dict, key);
+    if(index < 0) return fallback;
+    K values = kK(dict)[1];
+    J res = fallback;
+    if(values->t == KJ)
+        res = kJ(values)[index];
+    else if(values->t == KI)
+        res = kI(values)[index] == ni ? nj : kI(values)[index];
+    else if(values->t == 0 && kK(values)[index]->t == -KJ)
+        res = kK(values)[index]->j;
+    else if(values->t == 0 && kK(values)[index]->t == -KI)
+        res = kK(values)[index]->i == ni ? nj : kK(values)[index]->i;
+    return res == nj ? fallback : res;
+}
+
+B dictBool(K dict, std::string key, B fallback){
+    J index = dictIndex(dict, key);
+    if(index < 0) return fallback;
+    K values = kK(dict)[1];
+    if(values->t == KB)
+        return kG(values)[index];
+    if(values->t == 0 && kK(values)[index]->t == -KB)
+        return kK(values)[index]->g;
+    return fallback;
+}
@@ -18,179 +18,609 @@
 
 using namespace KDB::PARQ;
 
+namespace{
+    //Cells of an option column of a table, read as dictLong and dictBool read dictionary values
+    J tableLong(K table, const std::string& key, J row){
+        J index = dictIndex(table->k, key);
+        if(index < 0)
+            return nj;
+        K col = kK(kK(table->k)[1])[index];
+        K cell = col->t == 0 ? kK(col)[row] : nullptr;
+        if(col->t == KJ || (cell && cell->t == -KJ))
+            return cell ? cell->j : kJ(col)[row];
+        if(col->t == KI || (cell && cell->t == -KI)){
+            I value = cell ? cell->i : kI(col)[row];
+            return value == ni ? nj : value;
+        }
+        return nj;
+    }
+
+    std::optional<bool> tableBool(K table, const std::string& key, J row){
+        J index = dictIndex(table->k, key);
+        if(index < 0)
+            return std::nullopt;
+        K col = kK(kK(table->k)[1])[index];
+        if(col->t == KB)
+            return kG(col)[row];
+        if(col->t == 0 && kK(col)[row]->t == -KB)
+            return kK(col)[row]->g;
+        return true;
+    }
+}
+
 std::shared_ptr<arrow::KeyValueMetadata> WRITER::KeyValueMetadata(K metadata){
     return arrow::KeyValueMetadata(k2StrVec(kK(metadata)[0]), k2StrVec(kK(metadata)[1])).Copy();
 }
 
+std::vector<WRITER::ColumnOption> WRITER::ColumnOptions(K props){
+    std::vector<ColumnOption> columns;
+    K options = dictGet(props, "columns");
+    if(!options || options->t != XD || kK(options)[0]->t != KS)
+        return columns;
+    K names = kK(options)[0];
+    K values = kK(options)[1];
+    if(values->t != XT && values->t != 0)
+        throw std::runtime_error("Column options must be a dictionary of column to options");
+    for(J i=0;i<names->n;i++){
+        ColumnOption column;
+        column.name = kS(names)[i];
+        if(values->t == XT){
+            //Options with the same keys for every column collapse into a table in q
+            column.encoding = tableLong(values, "encoding", i);
+            column.dictionary = tableBool(values, "dictionary", i);
+            column.codec = tableLong(values, "codec", i);
+            column.compressionLevel = tableLong(values, "compressionLevel", i);
+        }
+        else{
+            K opts = kK(values)[i];
+            if(opts->t != XD)
+                continue;
+            column.encoding = dictLong(opts, "encoding", nj);
+            if(dictIndex(opts, "dictionary") >= 0)
+                column.dictionary = dictBool(opts, "dictionary", true);
+            column.codec = dictLong(opts, "codec", nj);
+            column.compressionLevel = dictLong(opts, "compressionLevel", nj);
+        }
+        columns.push_back(column);
+    }
+    return columns;
+}
+
+std::shared_ptr<parquet::WriterProperties> WRITER::WriterProperties(parquet::Compression::type codec, K props,
+                                                                    const std::vector<ColumnOption>& columns,
+                                                                    std::shared_ptr<GroupNode> schema){
+    parquet::WriterProperties::Builder builder;
+    FileProperties(builder, codec, props);
+
+    //Sort columns get statistics and a page index so readers can skip pages by range
+    K sortColumns = dictGet(props, "sortColumns");
+    if(sortColumns && sortColumns->t == KS && sortColumns->n){
+        std::vector<parquet::SortingColumn> sorting;
+        for(int i=0;i<sortColumns->n;i++){
+            int index = schema->FieldIndex(kS(sortColumns)[i]);
+            if(index < 0)
+                throw std::runtime_error(std::string{"Sort column not in table: "} + kS(sortColumns)[i]);
+            sorting.push_back(parquet::SortingColumn{index, false, true});
+            builder.enable_statistics(kS(sortColumns)[i]);
+            builder.enable_write_page_index(kS(sortColumns)[i]);
+        }
+        builder.set_sorting_columns(sorting);
+    }
+
+    //Column level settings override the file level ones
+    for(auto& column : columns)
+        ColumnProperties(builder, column);
+    return builder.build();
+}
+
+void WRITER::FileProperties(parquet::WriterProperties::Builder& builder, parquet::Compression::type codec, K props){
+    builder.memory_pool(&POOL::getInstance());
+    builder.compression(codec);
+    J level = dictLong(props, "compressionLevel", nj);
+    if(level != nj)
+        builder.compression_level(level);
+    if(!dictBool(props, "dictionary", true))
+        builder.disable_dictionary();
+    builder.dictionary_pagesize_limit(dictLong(props, "dictionaryPageSize", parquet::DEFAULT_DICTIONARY_PAGE_SIZE_LIMIT));
+    builder.data_pagesize(dictLong(props, "dataPageSize", parquet::kDefaultDataPageSize));
+    if(dictBool(props, "dataPageV2", false))
+        builder.data_page_version(parquet::ParquetDataPageVersion::V2);
+    if(dictBool(props, "pageIndex", false))
+        builder.enable_write_page_index();
+}
+
+void WRITER::ColumnProperties(parquet::WriterProperties::Builder& builder, const ColumnOption& column){
+    const std::string& name = column.name;
+    if(column.encoding != nj){
+        builder.encoding(name, parquet::Encoding::type(column.encoding));
+        //The encoding is only a fallback while the dictionary is on
+        if(!column.dictionary)
+            builder.disable_dictionary(name);
+    }
+    if(column.dictionary){
+        if(*column.dictionary)
+            builder.enable_dictionary(name);
+        else
+            builder.disable_dictionary(name);
+    }
+    if(column.codec != nj)
+        builder.compression(name, parquet::Compression::type(column.codec));
+    if(column.compressionLevel != nj)
+        builder.compression_level(name, column.compressionLevel);
+}
+
 std::shared_ptr<parquet::ParquetFileWriter> WRITER::OpenFile(std::string fileName, 
                                                              std::shared_ptr<GroupNode> schema,
                                                              parquet::Compression::type codec,
                                                              bool append,
-                                                             K metadata){
-    auto out_file = arrow::io::FileOutputStream::Open(fileName, append);
-    parquet::WriterProperties::Builder builder;
-    builder.compression(codec);
-    std::shared_ptr<parquet::WriterProperties> props = builder.build();
-    return parquet::ParquetFileWriter::Open(out_file.ValueOrDie(), schema, props, 
+                                                             K metadata,
+                                                             K props,
+                                                             const std::vector<ColumnOption>& columns,
+                                                             std::shared_ptr<arrow::io::OutputStream>& sink){
+    //The sink is handed back as closing the writer doesn't close it, see CloseFile
+    sink = OpenStream(fileName, append, props);
+    return parquet::ParquetFileWriter::Open(sink, schema,
+                                            WriterProperties(codec, props, columns, schema),
                                             metadata->n ? KeyValueMetadata(metadata) : NULLPTR);
 }
 
-std::shared_ptr<GroupNode> WRITER::SetupSchema(K names, K values, int numCols){
+void WRITER::CloseFile(std::shared_ptr<parquet::ParquetFileWriter> writer,
+                       std::shared_ptr<arrow::io::OutputStream> sink){
+    //Buffered streams only write out their last buffer, sync and close here, so a short write
+    //or a full disk is reported rather than lost in the stream's destructor
+    writer->Close();
+    PARQUET_THROW_NOT_OK(sink->Close());
+}
+
+std::shared_ptr<arrow::io::OutputStream> WRITER::OpenStream(const std::string& fileName, bool append, K props){
+    std::shared_ptr<arrow::io::OutputStream> out_file;
+    J buffer = dictLong(props, "writeBuffer", 0);
+    if(buffer > 0){
+        PARQUET_ASSIGN_OR_THROW(out_file, ASYNCFILE::Open(fileName, append, buffer,
+                                                          dictLong(props, "preallocate", 0),
+                                                          dictBool(props, "fsync", false),
+                                                          &POOL::getInstance()));
+    }
+    else{
+        PARQUET_ASSIGN_OR_THROW(out_file, arrow::io::FileOutputStream::Open(fileName, append));
+    }
+    return out_file;
+}
+
+std::shared_ptr<GroupNode> WRITER::SetupSchema(K names, K values, int numCols, bool nullable){
     parquet::schema::NodeVector fields;
     for(int i=0;i<numCols;i++){
         int colType = kK(values)[i]->t;
-        int firstType = colType == 0? kK(kK(values)[i])[0]->t : 0;
-        fields.push_back(k2parquet(kS(names)[i], colType, firstType));
+        int firstType = colType == 0 && kK(values)[i]->n ? kK(kK(values)[i])[0]->t : 0;
+        int itemType = colType == 0 ? listType(kK(values)[i]) : 0;
+        if(itemType)
+            fields.push_back(listNode(kS(names)[i], itemType, nullable));
+        else
+            fields.push_back(k2parquet(kS(names)[i], colType, firstType, nullable));
     }
     return std::static_pointer_cast<GroupNode>(
         GroupNode::Make("schema", Repetition::REQUIRED, fields));
 }
 
-parquet::schema::NodePtr WRITER::k2parquet(const std::string& name, int type, int firstType){
+parquet::schema::NodePtr WRITER::k2parquet(const std::string& name, int type, int firstType, bool nullable){
+    //Only types with a q null are written as OPTIONAL
+    Repetition::type repetition = nullable && hasNull(type) ? Repetition::OPTIONAL : Repetition::REQUIRED;
     if(type == KB)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::None(), Type::BOOLEAN);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::None(), Type::BOOLEAN);
     #if KXVER>=3
     else if(type == UU)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::UUID(), Type::FIXED_LEN_BYTE_ARRAY, 16);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::UUID(), Type::FIXED_LEN_BYTE_ARRAY, 16);
     #endif
     else if(type == KG)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::None(), Type::FIXED_LEN_BYTE_ARRAY, 1);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::None(), Type::FIXED_LEN_BYTE_ARRAY, 1);
     else if(type == KH)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::Int(16, true), Type::INT32);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::Int(16, true), Type::INT32);
     else if(type == KI)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::Int(32, true), Type::INT32);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::Int(32, true), Type::INT32);
     else if(type == KM || type == KU || type == KV)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::None(), Type::INT32);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::None(), Type::INT32);
     else if(type == KJ)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::Int(64, true), Type::INT64);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::Int(64, true), Type::INT64);
     else if(type == KE)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::None(), Type::FLOAT);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::None(), Type::FLOAT);
     else if(type == KF || type == KZ)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::None(), Type::DOUBLE);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::None(), Type::DOUBLE);
     else if(type == KC)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::String(), Type::BYTE_ARRAY);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::String(), Type::BYTE_ARRAY);
     else if(type == KS || (20 <= type && type <= 76))
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::Enum(), Type::BYTE_ARRAY);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::Enum(), Type::BYTE_ARRAY);
     else if(type == KP)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::Timestamp(false, LogicalType::TimeUnit::unit::NANOS), Type::INT64);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::Timestamp(false, LogicalType::TimeUnit::unit::NANOS), Type::INT64);
     else if(type == KN)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::Time(false, LogicalType::TimeUnit::unit::NANOS), Type::INT64);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::Time(false, LogicalType::TimeUnit::unit::NANOS), Type::INT64);
     else if(type == KD)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::Date(), Type::INT32);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::Date(), Type::INT32);
     else if(type == KT)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::Time(false, LogicalType::TimeUnit::unit::MILLIS), Type::INT32);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::Time(false, LogicalType::TimeUnit::unit::MILLIS), Type::INT32);
     else if(firstType == KC)
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::String(), Type::BYTE_ARRAY);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::String(), Type::BYTE_ARRAY);
     else
-        return PrimitiveNode::Make(name, Repetition::REQUIRED, parquet::LogicalType::None(), Type::BYTE_ARRAY);
+        return PrimitiveNode::Make(name, repetition, parquet::LogicalType::None(), Type::BYTE_ARRAY);
+}
+
+parquet::schema::NodePtr WRITER::listNode(const std::string& name, int itemType, bool nullable){
+    //The three level layout other engines read, elements are nullable as a column of their type would be
+    parquet::schema::NodePtr element = k2parquet("element", itemType, 0, nullable);
+    parquet::schema::NodePtr list = GroupNode::Make("list", Repetition::REPEATED, {element});
+    return GroupNode::Make(name, Repetition::REQUIRED, {list}, parquet::LogicalType::List());
+}
+
+int WRITER::listType(K col){
+    //Type shared by every item that isn't empty, when it's one written as a list element
+    int type = 0;
+    for(J i=0;i<col->n;i++){
+        K item = kK(col)[i];
+        if(item->t < 0 || (item->n && type && item->t != type))
+            return 0;
+        if(item->n && !type)
+            type = item->t;
+    }
+    switch(type){
+        case KB: case KH: case KI: case KJ: case KE: case KF: case KP:
+        case KM: case KD: case KZ: case KN: case KU: case KV: case KT:
+            return type;
+        default:
+            return 0;
+    }
+}
+
+bool WRITER::hasNull(int type){
+    switch(type){
+        case KH: case KI: case KJ: case KE: case KF: case KS: case KP: case KM:
+        case KD: case KZ: case KN: case KU: case KV: case KT:
+        #if KXVER>=3
+        case UU:
+        #endif
+            return true;
+        default:
+            return 20 <= type && type <= 76;
+    }
 }
 
 void WRITER::writeColumn(K col, parquet::RowGroupWriter* rg_writer){
     int type = col->t;
-    if(type == KB)
-        writeCol(static_cast<parquet::BoolWriter*>(rg_writer->NextColumn()), col->n, &kB(col)[0]);
+    parquet::ColumnWriter* writer = rg_writer->NextColumn();
+    STATS_COLUMN("write", writer->descr()->name());
+    STATS_TYPE(type);
+    STATS_ADD(rows, col->n);
+    if(writer->descr()->max_repetition_level() > 0)
+        writeListColumn(col, writer);
+    else if(writer->descr()->max_definition_level() > 0)
+        writeOptionalColumn(col, writer);
+    else if(type == KB)
+        writeCol(static_cast<parquet::BoolWriter*>(writer), col->n, &kB(col)[0]);
     #if KXVER>=3
     else if(type == UU)
-        writeGuidCol(static_cast<parquet::FixedLenByteArrayWriter*>(rg_writer->NextColumn()), col);
+        writeGuidCol(static_cast<parquet::FixedLenByteArrayWriter*>(writer), col);
     #endif
     else if(type == KG)
-        writeByteCol(static_cast<parquet::FixedLenByteArrayWriter*>(rg_writer->NextColumn()), col);
+        writeByteCol(static_cast<parquet::FixedLenByteArrayWriter*>(writer), col);
     else if(type == KH)
-        writeShortCol(static_cast<parquet::Int32Writer*>(rg_writer->NextColumn()), col);
+        writeShortCol(static_cast<parquet::Int32Writer*>(writer), col);
     else if(type == KI || type == KM || type == KU || type == KV || type == KT)
-        writeCol(static_cast<parquet::Int32Writer*>(rg_writer->NextColumn()), col->n, &kI(col)[0]);
-    else if(type == KD){
-        writeDateCol(static_cast<parquet::Int32Writer*>(rg_writer->NextColumn()), col);}
+        writeCol(static_cast<parquet::Int32Writer*>(writer), col->n, &kI(col)[0]);
+    else if(type == KD)
+        writeDateCol(static_cast<parquet::Int32Writer*>(writer), col);
     else if(type == KJ || type == KN)
-        writeCol(static_cast<parquet::Int64Writer*>(rg_writer->NextColumn()), col->n, &kJ64(col)[0]);
+        writeCol(static_cast<parquet::Int64Writer*>(writer), col->n, &kJ64(col)[0]);
     else if(type == KP)
-        writeTimestampCol(static_cast<parquet::Int64Writer*>(rg_writer->NextColumn()), col);
+        writeTimestampCol(static_cast<parquet::Int64Writer*>(writer), col);
     else if(type == KE)
-        writeCol(static_cast<parquet::FloatWriter*>(rg_writer->NextColumn()), col->n, &kE(col)[0]);
+        writeCol(static_cast<parquet::FloatWriter*>(writer), col->n, &kE(col)[0]);
     else if(type == KF || type == KZ)
-        writeCol(static_cast<parquet::DoubleWriter*>(rg_writer->NextColumn()), col->n, &kF(col)[0]);
+        writeCol(static_cast<parquet::DoubleWriter*>(writer), col->n, &kF(col)[0]);
     else if(type == KC)
-        writeCharCol(static_cast<parquet::ByteArrayWriter*>(rg_writer->NextColumn()), col);
+        writeCharCol(static_cast<parquet::ByteArrayWriter*>(writer), col);
     else if(type == KS)
-        writeSymCol(static_cast<parquet::ByteArrayWriter*>(rg_writer->NextColumn()), col);
+        writeSymCol(static_cast<parquet::ByteArrayWriter*>(writer), col);
     else if(20 <= type && type <= 76)
-        writeSymCol(static_cast<parquet::ByteArrayWriter*>(rg_writer->NextColumn()), d9(b9(-1,col)));
+        writeEnumCol(writer, col);
     else
-        writeCol(static_cast<parquet::ByteArrayWriter*>(rg_writer->NextColumn()), col);
+        writeCol(static_cast<parquet::ByteArrayWriter*>(writer), col);
+    //Pages still buffered in the writer are counted at their compressed size
+    STATS_ADD(bytes, writer->total_bytes_written() + writer->total_compressed_bytes());
+}
+
+void WRITER::writeOptionalColumn(K col, parquet::ColumnWriter* writer){
+    int type = col->t;
+    auto same = [](J64 n){ return n; };
+    if(type == KH)
+        writeOptionalCol<parquet::Int32Type>(writer, kH(col), col->n,
+                                             [](H n){ return n == static_cast<H>(nh); },
+                                             [](H n){ return static_cast<int32_t>(n); });
+    else if(type == KI || type == KM || type == KU || type == KV || type == KT)
+        writeOptionalCol<parquet::Int32Type>(writer, kI(col), col->n,
+                                             [](I n){ return n == ni; }, [](I n){ return n; });
+    else if(type == KD)
+        writeOptionalCol<parquet::Int32Type>(writer, kI(col), col->n,
+                                             [](I n){ return n == ni; }, [](I n){ return n + 10957; });
+    else if(type == KJ || type == KN)
+        writeOptionalCol<parquet::Int64Type>(writer, kJ64(col), col->n,
+                                             [](J64 n){ return n == nj; }, same);
+    else if(type == KP)
+        writeOptionalCol<parquet::Int64Type>(writer, kJ64(col), col->n,
+                                             [](J64 n){ return n == nj; }, [](J64 n){ return n + 946684800000000000; });
+    else if(type == KE)
+        writeOptionalCol<parquet::FloatType>(writer, kE(col), col->n,
+                                             [](E n){ return n != n; }, [](E n){ return n; });
+    else if(type == KF || type == KZ)
+        writeOptionalCol<parquet::DoubleType>(writer, kF(col), col->n,
+                                              [](F n){ return n != n; }, [](F n){ return n; });
+    else if(type == KS)
+        writeOptionalCol<parquet::ByteArrayType>(writer, kS(col), col->n,
+                                                 [](S n){ return !*n; },
+                                                 [](S n){ return parquet::ByteArray(std::strlen(n), reinterpret_cast<uint8_t*>(n)); });
+    #if KXVER>=3
+    else if(type == UU)
+        writeOptionalCol<parquet::FLBAType>(writer, kU(col), col->n,
+                                            [](const U& n){ return std::all_of(n.g, n.g + 16, [](G b){ return !b; }); },
+                                            [](const U& n){ return parquet::FixedLenByteArray(n.g); });
+    #endif
+    else if(20 <= type && type <= 76)
+        writeEnumCol(writer, col);
+    else
+        throw std::runtime_error("Column type can't be written as optional");
+}
+
+void WRITER::writeListColumn(K col, parquet::ColumnWriter* writer){
+    //Columns of empty lists have no item type of their own, any of the element's physical type will do
+    int type = col->t == 0 ? listType(col) : 0;
+    bool empty = col->t == 0 && std::all_of(kK(col), kK(col) + col->n, [](K item){ return !item->n; });
+    if(!type && empty)
+        type = writer->type() == Type::BOOLEAN ? KB : writer->type() == Type::INT32 ? KI :
+               writer->type() == Type::INT64 ? KJ : writer->type() == Type::FLOAT ? KE : KF;
+    const parquet::ColumnDescriptor* descr = writer->descr();
+    parquet::schema::NodePtr element = k2parquet("element", type, 0, false);
+    if(!type || (!empty && (!element->logical_type()->Equals(*descr->logical_type()) ||
+                            static_cast<const PrimitiveNode&>(*element).physical_type() != descr->physical_type())))
+        throw std::runtime_error("List items must all be of the column's type: " + descr->path()->ToDotVector()[0]);
+
+    auto same = [](J64 n){ return n; };
+    if(type == KB)
+        writeListCol<parquet::BooleanType, G>(writer, col, [](G){ return false; }, [](G n){ return static_cast<bool>(n); });
+    else if(type == KH)
+        writeListCol<parquet::Int32Type, H>(writer, col, [](H n){ return n == static_cast<H>(nh); },
+                                            [](H n){ return static_cast<int32_t>(n); });
+    else if(type == KI || type == KM || type == KU || type == KV || type == KT)
+        writeListCol<parquet::Int32Type, I>(writer, col, [](I n){ return n == ni; }, [](I n){ return n; });
+    else if(type == KD)
+        writeListCol<parquet::Int32Type, I>(writer, col, [](I n){ return n == ni; }, [](I n){ return n + 10957; });
+    else if(type == KJ || type == KN)
+        writeListCol<parquet::Int64Type, J64>(writer, col, [](J64 n){ return n == nj; }, same);
+    else if(type == KP)
+        writeListCol<parquet::Int64Type, J64>(writer, col, [](J64 n){ return n == nj; },
+                                              [](J64 n){ return n + 946684800000000000; });
+    else if(type == KE)
+        writeListCol<parquet::FloatType, E>(writer, col, [](E n){ return n != n; }, [](E n){ return n; });
+    else
+        writeListCol<parquet::DoubleType, F>(writer, col, [](F n){ return n != n; }, [](F n){ return n; });
+}
+
+uint8_t* WRITER::scratch(size_t bytes){
+    //One arena per thread, reused by every column and row group written on it
+    thread_local std::vector<uint8_t> arena;
+    if(arena.size() < bytes)
+        arena.resize(bytes);
+    return arena.data();
+}
+
+template<typename DType, typename V, typename Convert>
+void WRITER::writeChunked(parquet::ColumnWriter* writer, const V* values, J len, Convert convert){
+    using T = typename DType::c_type;
+    T* buffer = reinterpret_cast<T*>(scratch(std::min(len, chunkRows) * sizeof(T)));
+    for(J offset=0; offset<len; offset+=chunkRows){
+        J count = std::min(chunkRows, len - offset);
+        {
+            STATS_TIMER(convert);
+            //Plain loop over contiguous values so the conversion vectorizes
+            for(J i=0; i<count; i++)
+                buffer[i] = convert(values[offset + i]);
+        }
+        STATS_TIMER(encode);
+        static_cast<parquet::TypedColumnWriter<DType>*>(writer)->WriteBatch(count, nullptr, nullptr, buffer);
+    }
+}
+
+template<typename DType, typename V, typename IsNull, typename Convert>
+void WRITER::writeOptionalCol(parquet::ColumnWriter* writer, const V* values, J len, IsNull isNull, Convert convert){
+    using T = typename DType::c_type;
+    J size = std::min(len, chunkRows);
+    uint8_t* arena = scratch(size * (sizeof(T) + sizeof(int16_t)));
+    T* packed = reinterpret_cast<T*>(arena);
+    int16_t* defLevels = reinterpret_cast<int16_t*>(arena + size * sizeof(T));
+    for(J offset=0; offset<len; offset+=chunkRows){
+        J count = std::min(chunkRows, len - offset);
+        const V* chunk = values + offset;
+        {
+            STATS_TIMER(convert);
+            //Branch free so both the null scan and the packing vectorize
+            for(J i=0; i<count; i++)
+                defLevels[i] = !isNull(chunk[i]);
+            J packedCount = 0;
+            for(J i=0; i<count; i++){
+                packed[packedCount] = convert(chunk[i]);
+                packedCount += defLevels[i];
+            }
+        }
+        STATS_TIMER(encode);
+        static_cast<parquet::TypedColumnWriter<DType>*>(writer)->WriteBatch(count, defLevels, nullptr, packed);
+    }
+}
+
+template<typename DType, typename V, typename IsNull, typename Convert>
+void WRITER::writeListCol(parquet::ColumnWriter* writer, K col, IsNull isNull, Convert convert){
+    using T = typename DType::c_type;
+    int16_t maxDef = writer->descr()->max_definition_level();
+    bool optional = maxDef > 1;
+    for(J row=0; row<col->n;){
+        //Whole rows are taken until about chunkRows values are gathered, an empty list is one level
+        J end = row;
+        J levels = 0;
+        while(end < col->n && (end == row || levels + std::max<J>(1, kK(col)[end]->n) <= chunkRows))
+            levels += std::max<J>(1, kK(col)[end++]->n);
+        uint8_t* arena = scratch(levels * (sizeof(T) + 2 * sizeof(int16_t)));
+        T* packed = reinterpret_cast<T*>(arena);
+        int16_t* defLevels = reinterpret_cast<int16_t*>(arena + levels * sizeof(T));
+        int16_t* repLevels = defLevels + levels;
+        J position = 0;
+        J count = 0;
+        {
+            STATS_TIMER(convert);
+            //Levels are filled a run per row from the item lengths, values are packed as in optional columns
+            for(J i=row; i<end; i++){
+                K item = kK(col)[i];
+                const V* values = reinterpret_cast<const V*>(kG(item));
+                J n = item->n;
+                if(!n){
+                    defLevels[position] = 0;
+                    repLevels[position++] = 0;
+                    continue;
+                }
+                std::fill(repLevels + position, repLevels + position + n, 1);
+                repLevels[position] = 0;
+                if(optional){
+                    for(J j=0; j<n; j++)
+                        defLevels[position + j] = maxDef - isNull(values[j]);
+                    for(J j=0; j<n; j++){
+                        packed[count] = convert(values[j]);
+                        count += defLevels[position + j] == maxDef;
+                    }
+                }else{
+                    std::fill(defLevels + position, defLevels + position + n, maxDef);
+                    for(J j=0; j<n; j++)
+                        packed[count + j] = convert(values[j]);
+                    count += n;
+                }
+                position += n;
+            }
+        }
+        STATS_TIMER(encode);
+        static_cast<parquet::TypedColumnWriter<DType>*>(writer)->WriteBatch(position, defLevels, repLevels, packed);
+        row = end;
+    }
 }
 
 template<typename T, typename T1>
 void WRITER::writeCol(T writer, int len, T1 col){
+    STATS_TIMER(encode);
     writer->WriteBatch(len, nullptr, nullptr, col);
 }
 
 #if KXVER>=3
 void WRITER::writeGuidCol(parquet::FixedLenByteArrayWriter* writer, K col){
-    writer->WriteBatch(col->n, nullptr, nullptr, &std::vector<parquet::FixedLenByteArray>(&kU(col)->g, &kU(col)->g + col->n)[0]);
+    writeChunked<parquet::FLBAType>(writer, kU(col), col->n,
+                                    [](const U& n){ return parquet::FixedLenByteArray(n.g); });
 }
 #endif
 
 void WRITER::writeByteCol(parquet::FixedLenByteArrayWriter* writer, K col){
-    writer->WriteBatch(col->n, nullptr, nullptr, &std::vector<parquet::FixedLenByteArray>(&kG(col), &kG(col) + col->n)[0]);
+    writeChunked<parquet::FLBAType>(writer, kG(col), col->n,
+                                    [](const G& n){ return parquet::FixedLenByteArray(&n); });
 }
 
 void WRITER::writeDateCol(parquet::Int32Writer* writer, K col){
-    //need to copy because changing the underlying value
-    std::vector<int32_t> cpy(kI(col), kI(col)+col->n);
-    std::for_each(cpy.begin(), cpy.end(), [](int32_t &n){ n+=10957; });
-    writer->WriteBatch(col->n, nullptr, nullptr, &cpy[0]);
+    writeChunked<parquet::Int32Type>(writer, kI(col), col->n, [](I n){ return n + 10957; });
 }
 
 void WRITER::writeShortCol(parquet::Int32Writer* writer, K col){
-    writer->WriteBatch(col->n, nullptr, nullptr, &std::vector<int32_t>(&kH(col)[0], &kH(col)[0] + col->n)[0]);
+    writeChunked<parquet::Int32Type>(writer, kH(col), col->n, [](H n){ return static_cast<int32_t>(n); });
 }
 
 void WRITER::writeTimestampCol(parquet::Int64Writer* writer, K col){
-    //need to copy because changing the underlying value
-    std::vector<int64_t> cpy(kJ(col), kJ(col)+col->n);
-    std::for_each(cpy.begin(), cpy.end(), [](int64_t &n){ n+=946684800000000000; });
-    writer->WriteBatch(col->n, nullptr, nullptr, &cpy[0]);
+    writeChunked<parquet::Int64Type>(writer, kJ64(col), col->n, [](J64 n){ return n + 946684800000000000; });
 }
 
 void WRITER::writeCol(parquet::Int96Writer* writer, K col){
-    for (int i = 0; i < col->n; i++){
+    writeChunked<parquet::Int96Type>(writer, kJ64(col), col->n, [](J64 n){
         parquet::Int96 value;
         //Magic number that adjusts for julian days
         value.value[2]=2451545;
-        parquet::Int96SetNanoSeconds(value,kJ(col)[i]);
-        writer->WriteBatch(1, nullptr, nullptr, &value);
-    }
+        parquet::Int96SetNanoSeconds(value,n);
+        return value;
+    });
 }
 
 void WRITER::writeCharCol(parquet::ByteArrayWriter* writer, K col){
-    writer->WriteBatch(col->n, nullptr, nullptr, &byteToVec(col)[0]);
-}
-
-std::vector<parquet::ByteArray> WRITER::byteToVec(K col){
-    std::vector<parquet::ByteArray> buffer;
-    for(int i=0; i<col->n; i++)
-        buffer.push_back(parquet::ByteArray(1,&kG(col)[i]));
-    return buffer;
+    writeChunked<parquet::ByteArrayType>(writer, kG(col), col->n,
+                                         [](const G& n){ return parquet::ByteArray(1, &n); });
 }
 
 void WRITER::writeSymCol(parquet::ByteArrayWriter* writer, K col){
-    writer->WriteBatch(col->n, nullptr, nullptr, &stringToVec(col)[0]);
+    writeChunked<parquet::ByteArrayType>(writer, kS(col), col->n,
+                                         [](S n){ return parquet::ByteArray(std::strlen(n), reinterpret_cast<uint8_t*>(n)); });
 }
 
-std::vector<parquet::ByteArray> WRITER::stringToVec(K col){
-    std::vector<parquet::ByteArray> buffer;
-    for(int i=0; i<col->n; i++)
-        buffer.push_back(parquet::ByteArray(std::string(kS(col)[i]).length(),reinterpret_cast<unsigned char*>(kS(col)[i])));
-    return buffer;
+K WRITER::enumDomain(K col){
+    K domain = k(0, const_cast<S>("{value key x}"), r1(col), (K)0);
+    if(!domain)
+        throw std::runtime_error("Unable to resolve enumeration domain");
+    if(domain->t != KS){
+        std::string error = domain->t == -128 ? std::string{domain->s} : "Enumeration domain must be a sym list";
+        r0(domain);
+        throw std::runtime_error(error);
+    }
+    return domain;
 }
 
-void WRITER::writeCol(parquet::ByteArrayWriter* writer, K col){
-    writer->WriteBatch(col->n, nullptr, nullptr, &kToVec(col)[0]);
+void WRITER::writeEnumCol(parquet::ColumnWriter* writer, K col){
+    //Everything before the dictionary write is conversion
+    STATS_TIMER(convert);
+    //Resolve the domain once instead of serializing the column to syms
+    K domain = enumDomain(col);
+
+    //Only the slice of the domain spanned by the column goes in the dictionary
+    J64 lo = col->n ? *std::min_element(kJ64(col), kJ64(col) + col->n) : 0;
+    J64 hi = col->n ? *std::max_element(kJ64(col), kJ64(col) + col->n) : -1;
+    if(lo < 0 || hi >= domain->n || hi - lo >= std::numeric_limits<int32_t>::max()){
+        r0(domain);
+        throw std::runtime_error("Enumeration index out of range of its domain");
+    }
+
+    //Optional columns mark enumerations of the null sym as nulls
+    bool optional = writer->descr()->max_definition_level() > 0;
+    std::vector<int16_t> defLevels(optional ? col->n : 0);
+    std::shared_ptr<arrow::Buffer> validity;
+    int64_t nullCount = 0;
+    if(optional){
+        PARQUET_ASSIGN_OR_THROW(validity, arrow::AllocateBitmap(col->n, &POOL::getInstance()));
+        for(J i=0; i<col->n; i++){
+            defLevels[i] = *kS(domain)[kJ64(col)[i]] != 0;
+            arrow::bit_util::SetBitTo(validity->mutable_data(), i, defLevels[i]);
+            nullCount += !defLevels[i];
+        }
+    }
+
+    std::shared_ptr<arrow::Array> dictionary;
+    arrow::StringBuilder dictBuilder;
+    for(J64 i=lo; i<=hi; i++){
+        S sym = kS(domain)[i];
+        PARQUET_THROW_NOT_OK(dictBuilder.Append(sym, std::strlen(sym)));
+    }
+    r0(domain);
+    PARQUET_THROW_NOT_OK(dictBuilder.Finish(&dictionary));
+
+    PARQUET_ASSIGN_OR_THROW(std::shared_ptr<arrow::Buffer> indexBuffer,
+                            arrow::AllocateBuffer(col->n * sizeof(int32_t), &POOL::getInstance()));
+    int32_t* indices = reinterpret_cast<int32_t*>(indexBuffer->mutable_data());
+    std::transform(kJ64(col), kJ64(col) + col->n, indices, [lo](J64 n){ return static_cast<int32_t>(n - lo); });
+
+    PARQUET_ASSIGN_OR_THROW(std::shared_ptr<arrow::Array> enums,
+                            arrow::DictionaryArray::FromArrays(arrow::dictionary(arrow::int32(), arrow::utf8()),
+                                                               std::make_shared<arrow::Int32Array>(col->n, indexBuffer,
+                                                                                                   validity, nullCount),
+                                                               dictionary));
+    parquet::ArrowWriteContext ctx(&POOL::getInstance(), parquet::default_arrow_writer_properties().get());
+    STATS_TIMER(encode);
+    PARQUET_THROW_NOT_OK(writer->WriteArrow(optional ? defLevels.data() : nullptr, nullptr, col->n,
+                                            *enums, &ctx, optional));
 }
 
-std::vector<parquet::ByteArray> WRITER::kToVec(K col){
-    std::vector<parquet::ByteArray> buffer;
-    for(int i=0; i<col->n; i++)
-        buffer.push_back(parquet::ByteArray(kK(col)[i]->n,kG(kK(col)[i])));
-    return buffer;
+void WRITER::writeCol(parquet::ByteArrayWriter* writer, K col){
+    writeChunked<parquet::ByteArrayType>(writer, kK(col), col->n,
+                                         [](K n){ return parquet::ByteArray(n->n, kG(n)); });
 }
\ No newline at end of file